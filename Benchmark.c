@@ -0,0 +1,430 @@
+/**
+ * @file Benchmark.c
+ * @author  Jason Elter <jason.elter@mail.huji.ac.il>
+ * @version 1.0
+ * @date 10 December 2019
+ *
+ * @brief Micro benchmarks for the red-black tree library.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "RBTree.h"
+#include "Structs.h"
+
+// Number of items in the benchmarked trees.
+#define TREE_SIZE (1 << 20)
+// Number of lookups timed in every benchmark.
+#define LOOKUPS (1 << 22)
+// Number of keys passed to every call of a batched lookup.
+#define BATCH_SIZE 256
+// Number of words in the benchmarked string trees.
+#define WORDS 20000
+// Number of vectors of the benchmarked k-d tree, their length, and the number of neighbours every query finds.
+#define KD_VECTORS (1 << 17)
+#define KD_DIM 3
+#define KD_NEIGHBOURS 10
+// Number of changes per sync of the benchmarked logged trees.
+#define LOG_GROUP 256
+
+// Number of calls to intCompare so far.
+static long comparisons = 0;
+
+// CompFunc for int items.
+static int intCompare(const void *a, const void *b)
+{
+    int first = *(const int *) a, second = *(const int *) b;
+    comparisons++;
+    return (first > second) - (first < second);
+}
+
+// KeyExtractFunc for int items (flipping the sign bit keeps the order of negative numbers).
+static uint64_t intKey(const void *a)
+{
+    return (uint64_t) (int64_t) *(const int *) a ^ ((uint64_t) 1 << 63);
+}
+
+// HashFunc for int items.
+static size_t intHash(const void *a)
+{
+    return (size_t) (unsigned int) *(const int *) a;
+}
+
+// FreeFunc for int items.
+static void intFree(void *a)
+{
+    free(a);
+}
+
+// FreeFunc for items that belong to someone else.
+static void intKeep(void *a)
+{
+    (void) a;
+}
+
+// Returns the next number of a xorshift sequence (deterministic, so runs are comparable).
+static unsigned int nextRandom(unsigned int *state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Returns the current time in seconds.
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Prints the time per lookup of a benchmark and how many keys it found.
+static void report(const char *name, double seconds, long found)
+{
+    printf("%-28s %8.1f ns/lookup (%ld found)\n", name, seconds * 1e9 / LOOKUPS, found);
+}
+
+// Times adding TREE_SIZE ascending items, with or without the last insertion finger.
+static void benchmarkSortedInsert(int useFinger)
+{
+    RBTree *tree = newRBTree(intCompare, intFree);
+    int *items = (int *) malloc(sizeof(int) * TREE_SIZE);
+    setFingerRBTree(tree, useFinger);
+
+    comparisons = 0;
+    double start = now();
+    for (int i = 0; i < TREE_SIZE; i++)
+    {
+        items[i] = i;
+        addToRBTree(tree, &items[i]);
+    }
+    double seconds = now() - start;
+    printf("%-28s %8.1f ns/insert, %.1f comparisons/insert\n", useFinger ? "sorted insert (finger)" : "sorted insert",
+           seconds * 1e9 / TREE_SIZE, (double) comparisons / TREE_SIZE);
+
+    // The items share one allocation, so only the nodes are freed with the tree.
+    tree->freeFunc = intKeep;
+    freeRBTree(tree);
+    free(items);
+}
+
+// Times using the tree as a priority queue: adding random items and popping the smallest one each time.
+static void benchmarkPopMin()
+{
+    RBTree *tree = newRBTree(intCompare, intFree);
+    unsigned int state = 521288629u;
+    for (int i = 0; i < TREE_SIZE; i++)
+    {
+        int *item = (int *) malloc(sizeof(int));
+        *item = (int) (nextRandom(&state) % (4 * TREE_SIZE));
+        if (!addToRBTree(tree, item))
+        {
+            free(item);
+        }
+    }
+
+    int pops = tree->size;
+    double start = now();
+    while (tree->size > 0)
+    {
+        free(popMinRBTree(tree));
+    }
+    printf("%-28s %8.1f ns/pop\n", "popMinRBTree", (now() - start) * 1e9 / pops);
+    freeRBTree(tree);
+}
+
+// Times nearest neighbour queries on a k-d tree of random vectors, against scanning all of them.
+static void benchmarkKDTree(void)
+{
+    unsigned int state = 1013904223u;
+    Vector **vectors = (Vector **) malloc(sizeof(Vector *) * KD_VECTORS);
+    for (int i = 0; i < KD_VECTORS; i++)
+    {
+        vectors[i] = (Vector *) malloc(sizeof(Vector));
+        vectors[i]->len = KD_DIM;
+        vectors[i]->vector = (double *) malloc(sizeof(double) * KD_DIM);
+        for (int j = 0; j < KD_DIM; j++)
+        {
+            vectors[i]->vector[j] = (double) nextRandom(&state) / UINT32_MAX;
+        }
+    }
+    KDTree *kdTree = newKDTree(vectors, KD_VECTORS);
+
+    int queries = LOOKUPS / 64;
+    double query[KD_DIM];
+    Vector queryVector = {KD_DIM, query};
+    Vector *results[KD_NEIGHBOURS];
+    double sum = 0;
+    double start = now();
+    for (int q = 0; q < queries; q++)
+    {
+        for (int j = 0; j < KD_DIM; j++)
+        {
+            query[j] = (double) nextRandom(&state) / UINT32_MAX;
+        }
+        nearestVectorsKDTree(kdTree, &queryVector, KD_NEIGHBOURS, results);
+        sum += results[KD_NEIGHBOURS - 1]->vector[0];
+    }
+    printf("%-28s %8.1f ns/query (%d neighbours of %d vectors)\n", "nearestVectorsKDTree",
+           (now() - start) * 1e9 / queries, KD_NEIGHBOURS, KD_VECTORS);
+
+    // A scan that only keeps the single nearest vector, which is a lower bound for a brute force search.
+    int scans = queries / 256;
+    start = now();
+    for (int q = 0; q < scans; q++)
+    {
+        double best = 1e300;
+        for (int i = 0; i < KD_VECTORS; i++)
+        {
+            double distance = 0;
+            for (int j = 0; j < KD_DIM; j++)
+            {
+                double difference = vectors[i]->vector[j] - query[j];
+                distance += difference * difference;
+            }
+            best = (distance < best) ? distance : best;
+        }
+        sum += best;
+    }
+    printf("%-28s %8.1f ns/query (%s)\n", "scan", (now() - start) * 1e9 / scans, sum >= 0 ? "done" : "");
+    freeKDTree(kdTree);
+    free(vectors);
+}
+
+// SerializeFunc for int items.
+static size_t intSerialize(const void *a, void *buffer, size_t capacity)
+{
+    if (capacity >= sizeof(int))
+    {
+        memcpy(buffer, a, sizeof(int));
+    }
+    return sizeof(int);
+}
+
+// DeserializeFunc for int items.
+static void *intDeserialize(const void *buffer, size_t size)
+{
+    int *item = (size == sizeof(int)) ? (int *) malloc(sizeof(int)) : NULL;
+    if (item != NULL)
+    {
+        memcpy(item, buffer, sizeof(int));
+    }
+    return item;
+}
+
+// Times logging TREE_SIZE random insertions, and recovering them from the log alone and from a checkpoint.
+static void benchmarkRecovery()
+{
+    const char *directory = "Benchmark.log";
+    mkdir(directory, 0755);
+    remove("Benchmark.log/log");
+    remove("Benchmark.log/checkpoint");
+    RBTree *tree = openLoggedRBTree(intCompare, intFree, intSerialize, intDeserialize, directory, LOG_GROUP, 0);
+    if (tree == NULL)
+    {
+        printf("could not open a logged tree\n");
+        return;
+    }
+
+    unsigned int state = 3141592653u;
+    double start = now();
+    for (int i = 0; i < TREE_SIZE; i++)
+    {
+        int *item = (int *) malloc(sizeof(int));
+        *item = (int) (nextRandom(&state) % (4 * TREE_SIZE));
+        if (!addToRBTree(tree, item))
+        {
+            free(item);
+        }
+    }
+    syncRBTreeLog(tree);
+    printf("%-28s %8.1f ns/insert\n", "logged insert", (now() - start) * 1e9 / TREE_SIZE);
+    freeRBTree(tree);
+
+    start = now();
+    tree = openLoggedRBTree(intCompare, intFree, intSerialize, intDeserialize, directory, LOG_GROUP, 0);
+    int size = tree->size;
+    printf("%-28s %8.1f ns/item\n", "recovery (log replay)", (now() - start) * 1e9 / size);
+    checkpointRBTree(tree);
+    freeRBTree(tree);
+
+    start = now();
+    tree = openLoggedRBTree(intCompare, intFree, intSerialize, intDeserialize, directory, LOG_GROUP, 0);
+    printf("%-28s %8.1f ns/item (%s)\n", "recovery (checkpoint)", (now() - start) * 1e9 / size,
+           tree->size == size ? "same" : "different");
+    freeRBTree(tree);
+
+    remove("Benchmark.log/log");
+    remove("Benchmark.log/checkpoint");
+    remove(directory);
+}
+
+// Times exporting a tree of WORDS strings with concatenate and with exportStrings.
+static void benchmarkExport()
+{
+    RBTree *tree = newRBTree(stringCompare, freeString);
+    unsigned int state = 88172645u;
+    for (int i = 0; i < WORDS; i++)
+    {
+        char *word = (char *) malloc(16);
+        sprintf(word, "word%u", nextRandom(&state) % 1000000);
+        if (!addToRBTree(tree, word))
+        {
+            free(word);
+        }
+    }
+
+    size_t length = exportedStringsLength(tree);
+    char *concatenated = (char *) calloc(length + 1, 1);
+    double start = now();
+    forEachRBTree(tree, concatenate, concatenated);
+    double seconds = now() - start;
+    printf("%-28s %8.1f ns/word (%zu characters)\n", "concatenate", seconds * 1e9 / tree->size, length);
+
+    start = now();
+    char *exported = exportStrings(tree);
+    seconds = now() - start;
+    printf("%-28s %8.1f ns/word (%s)\n", "exportStrings", seconds * 1e9 / tree->size,
+           strcmp(exported, concatenated) == 0 ? "same" : "different");
+
+    free(exported);
+    free(concatenated);
+    freeRBTree(tree);
+}
+
+int main()
+{
+    RBTree *tree = newRBTree(intCompare, intFree);
+    unsigned int state = 2463534242u;
+    for (int i = 0; i < TREE_SIZE; i++)
+    {
+        // Only even numbers go in, so about half of the lookups below miss.
+        int *item = (int *) malloc(sizeof(int));
+        *item = 2 * (int) (nextRandom(&state) % TREE_SIZE);
+        if (!addToRBTree(tree, item))
+        {
+            free(item);
+        }
+    }
+
+    int *queries = (int *) malloc(sizeof(int) * LOOKUPS);
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        queries[i] = (int) (nextRandom(&state) % (2 * TREE_SIZE));
+    }
+    printf("%d items, %d lookups\n", tree->size, LOOKUPS);
+
+    long found = 0;
+    double start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += containsRBTree(tree, &queries[i]) != 0;
+    }
+    report("containsRBTree", now() - start, found);
+
+    void **keys = (void **) malloc(sizeof(void *) * LOOKUPS);
+    int *results = (int *) malloc(sizeof(int) * BATCH_SIZE);
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        keys[i] = &queries[i];
+    }
+    found = 0;
+    start = now();
+    for (int i = 0; i < LOOKUPS; i += BATCH_SIZE)
+    {
+        containsBatchRBTree(tree, keys + i, BATCH_SIZE, results);
+        for (int j = 0; j < BATCH_SIZE; j++)
+        {
+            found += results[j] != 0;
+        }
+    }
+    report("containsBatchRBTree", now() - start, found);
+    free(results);
+    free(keys);
+
+    FrozenRBTree *frozen = freezeRBTree(tree);
+    found = 0;
+    start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += containsFrozenRBTree(frozen, &queries[i]) != 0;
+    }
+    report("containsFrozenRBTree", now() - start, found);
+    freeFrozenRBTree(frozen);
+
+    frozen = freezeRBTreeWithKeys(tree, FROZEN_KEY_INT, 0);
+    found = 0;
+    start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += containsFrozenRBTree(frozen, &queries[i]) != 0;
+    }
+    report("containsFrozenRBTree (int)", now() - start, found);
+    freeFrozenRBTree(frozen);
+
+    freeRBTree(tree);
+
+    // The same items again, in a tree that keeps their normalized keys in its nodes.
+    tree = newRBTree(intCompare, intFree);
+    setKeyExtractRBTree(tree, intKey);
+    state = 2463534242u;
+    for (int i = 0; i < TREE_SIZE; i++)
+    {
+        int *item = (int *) malloc(sizeof(int));
+        *item = 2 * (int) (nextRandom(&state) % TREE_SIZE);
+        if (!addToRBTree(tree, item))
+        {
+            free(item);
+        }
+    }
+    found = 0;
+    start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += containsRBTree(tree, &queries[i]) != 0;
+    }
+    report("containsRBTree (int keys)", now() - start, found);
+
+    frozen = freezeRBTree(tree);
+    found = 0;
+    start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += containsFrozenRBTree(frozen, &queries[i]) != 0;
+    }
+    report("containsFrozenRBTree (keys)", now() - start, found);
+    freeFrozenRBTree(frozen);
+
+    enableHashIndexRBTree(tree, intHash);
+    found = 0;
+    start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += containsRBTree(tree, &queries[i]) != 0;
+    }
+    report("containsRBTree (hash index)", now() - start, found);
+
+    RBTreeMemory memory;
+    memoryRBTree(tree, &memory);
+    printf("tree %zu bytes, hash index %zu bytes (%.0f%% full)\n", memory.treeBytes, memory.hashIndexBytes,
+           memory.hashLoadFactor * 100);
+
+    free(queries);
+    freeRBTree(tree);
+
+    benchmarkSortedInsert(0);
+    benchmarkSortedInsert(1);
+    benchmarkPopMin();
+    benchmarkExport();
+    benchmarkKDTree();
+    benchmarkRecovery();
+    return 0;
+}
@@ -9,10 +9,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define LESS (-1)
 #define EQUAL (0)
 #define GREATER (1)
+// Number of products made by newNumberedProduct for the tests of large trees.
+#define MANY_PRODUCTS 3000
+// Length of the names of numbered products, with their "\0".
+#define NUMBERED_NAME 20
 
 typedef struct ProductExample
 {
@@ -20,6 +27,10 @@ typedef struct ProductExample
     double price;
 } ProductExample;
 
+// The indices of the products of getProducts sorted by name: "Apple TV", "Apple Watch", "MacBook Pro", "iPad",
+// "iPhone", "iPod".
+static const int byName[6] = {5, 4, 0, 3, 2, 1};
+
 /**
  * Comparator for ProductExample
  * @param a ProductExample*
@@ -45,6 +56,116 @@ int productComparatorByName(const void *a, const void *b)
     }
 }
 
+/**
+ * KeyExtractFunc for ProductExample that keeps the order of productComparatorByName
+ * @param a ProductExample*
+ * @return the first 8 characters of the name as a big endian number
+ */
+uint64_t productKeyByName(const void *a)
+{
+    const unsigned char *name = (const unsigned char *) ((ProductExample *) a)->name;
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        key = (key << 8) | name[i];
+        if (name[i] == '\0')
+        {
+            key <<= 8 * (7 - i);
+            break;
+        }
+    }
+    return key;
+}
+
+/**
+ * HashFunc for ProductExample, by name (djb2)
+ * @param a ProductExample*
+ * @return the hash of the name
+ */
+size_t productHashByName(const void *a)
+{
+    const unsigned char *name = (const unsigned char *) ((ProductExample *) a)->name;
+    size_t hash = 5381;
+    for (; *name != '\0'; name++)
+    {
+        hash = hash * 33 + *name;
+    }
+    return hash;
+}
+
+/**
+ * HashFunc for numbered products that gives 16 products in a row the same hash, so their entries collide
+ * in a hash index
+ * @param a ProductExample* made by newNumberedProduct
+ * @return the hash of the product
+ */
+size_t productHashByPriceRange(const void *a)
+{
+    return (size_t) ((ProductExample *) a)->price / 16;
+}
+
+/**
+ * SerializeFunc for ProductExample: the price followed by the name
+ * @param a ProductExample*
+ * @return the size of the written product
+ */
+size_t productSerialize(const void *a, void *buffer, size_t capacity)
+{
+    const ProductExample *pProduct = (const ProductExample *) a;
+    size_t length = strlen(pProduct->name), size = sizeof(double) + length;
+    if (size <= capacity)
+    {
+        memcpy(buffer, &pProduct->price, sizeof(double));
+        memcpy((char *) buffer + sizeof(double), pProduct->name, length);
+    }
+    return size;
+}
+
+/**
+ * DeserializeFunc for ProductExample
+ * @return a new product (freed with productFree), or NULL on failure
+ */
+void *productDeserialize(const void *buffer, size_t size)
+{
+    ProductExample *pProduct = (ProductExample *) malloc(sizeof(ProductExample));
+    char *name = (size >= sizeof(double)) ? (char *) malloc(size - sizeof(double) + 1) : NULL;
+    if (pProduct == NULL || name == NULL)
+    {
+        free(pProduct);
+        free(name);
+        return NULL;
+    }
+    memcpy(&pProduct->price, buffer, sizeof(double));
+    memcpy(name, (const char *) buffer + sizeof(double), size - sizeof(double));
+    name[size - sizeof(double)] = '\0';
+    pProduct->name = name;
+    return pProduct;
+}
+
+/**
+ * DeserializeFunc like productDeserialize that fails on "Apple Watch", as if it ran out of memory
+ * @return a new product (freed with productFree), or NULL on failure
+ */
+void *failingWatchDeserialize(const void *buffer, size_t size)
+{
+    const char *name = "Apple Watch";
+    size_t length = strlen(name);
+    if (size == sizeof(double) + length && memcmp((const char *) buffer + sizeof(double), name, length) == 0)
+    {
+        return NULL;
+    }
+    return productDeserialize(buffer, size);
+}
+
+/**
+ * @return a new copy of the product (freed with productFree)
+ */
+ProductExample *productCopy(const ProductExample *pProduct)
+{
+    char buffer[64];
+    return (ProductExample *) productDeserialize(buffer, productSerialize(pProduct, buffer, sizeof(buffer)));
+}
+
 void productFree(void *a)
 {
     ProductExample *pProduct = (ProductExample *) a;
@@ -52,6 +173,28 @@ void productFree(void *a)
     free(a);
 }
 
+/**
+ * FreeFunc for trees that don't own their products
+ */
+void productKeep(void *a)
+{
+    (void) a;
+}
+
+/**
+ * Number of products passed to productCountFree
+ */
+int freedProducts = 0;
+
+/**
+ * FreeFunc that counts the products instead of freeing them
+ */
+void productCountFree(void *a)
+{
+    (void) a;
+    freedProducts++;
+}
+
 /**
  *
  * @param pProduct pointer to product to print
@@ -133,6 +276,681 @@ void assertion(int passed, int assertion_num, char *msg)
 
 }
 
+/**
+ * ForEach function that checks the products come in ascending order.
+ * @param pProduct pointer to the current product
+ * @param pPrevious pointer to the previous product (NULL before the first one)
+ * @return 1 if pProduct comes after the previous product, 0 otherwise
+ */
+int checkAscending(const void *pProduct, void *pPrevious)
+{
+    ProductExample **previous = (ProductExample **) pPrevious;
+    if (*previous != NULL && productComparatorByName(*previous, pProduct) != LESS)
+    {
+        return 0;
+    }
+    *previous = (ProductExample *) pProduct;
+    return 1;
+}
+
+/**
+ * @return a new product named "product <number>" (zero padded, so the names keep the order of the numbers)
+ * that costs number (freed with productFree)
+ */
+ProductExample *newNumberedProduct(int number)
+{
+    ProductExample *pProduct = (ProductExample *) malloc(sizeof(ProductExample));
+    pProduct->name = (char *) malloc(NUMBERED_NAME);
+    snprintf(pProduct->name, NUMBERED_NAME, "product %05d", number);
+    pProduct->price = number;
+    return pProduct;
+}
+
+/**
+ * @return 1 if the product of the given number is in the tree, 0 otherwise
+ */
+int containsNumberedProduct(RBTree *tree, int number)
+{
+    char name[NUMBERED_NAME];
+    snprintf(name, NUMBERED_NAME, "product %05d", number);
+    ProductExample probe = {name, number};
+    return containsRBTree(tree, &probe);
+}
+
+/**
+ * @return the number of black nodes on every path from node down to a leaf, or -1 if they differ, a red
+ * node has a red child or a child doesn't point back to its parent
+ */
+int blackHeight(const Node *node)
+{
+    if (node == NULL)
+    {
+        return 0;
+    }
+    const Node *children[2] = {node->left, node->right};
+    for (int i = 0; i < 2; i++)
+    {
+        if (children[i] != NULL &&
+            (children[i]->parent != node || (node->color == RED && children[i]->color == RED)))
+        {
+            return -1;
+        }
+    }
+    int left = blackHeight(node->left), right = blackHeight(node->right);
+    if (left < 0 || left != right)
+    {
+        return -1;
+    }
+    return left + (node->color == BLACK);
+}
+
+/**
+ * Checks that the tree holds exactly the numbered products marked in isIn, in order, with the right
+ * smallest and largest ones, and that it is still a red-black tree.
+ * @return 1 if it does, 0 otherwise
+ */
+int checkNumberedProducts(RBTree *tree, const char *isIn)
+{
+    int count = 0, first = -1, last = -1;
+    for (int i = 0; i < MANY_PRODUCTS; i++)
+    {
+        if (containsNumberedProduct(tree, i) != isIn[i])
+        {
+            return 0;
+        }
+        if (isIn[i])
+        {
+            first = (first < 0) ? i : first;
+            last = i;
+            count++;
+        }
+    }
+
+    ProductExample *previous = NULL;
+    ProductExample *min = (ProductExample *) minRBTree(tree), *max = (ProductExample *) maxRBTree(tree);
+    return tree->size == count && blackHeight(tree->root) >= 0 &&
+           (tree->root == NULL || tree->root->color == BLACK) && forEachRBTree(tree, checkAscending, &previous) &&
+           (count == 0 || (min->price == first && max->price == last));
+}
+
+/**
+ * Checks that a frozen copy of the tree finds the same products as the tree and keeps their order.
+ * @return 1 if the frozen tree agrees with the tree, 0 otherwise
+ */
+int testFrozenTree(RBTree *tree, ProductExample **products)
+{
+    FrozenRBTree *frozen = freezeRBTree(tree);
+    if (frozen == NULL || frozen->size != tree->size)
+    {
+        freeFrozenRBTree(frozen);
+        return 0;
+    }
+
+    // The tree has no KeyExtractFunc for normalized keys, and key types outside the enum are refused too.
+    int passed = 1;
+    if (freezeRBTreeWithKeys(tree, FROZEN_KEY_NORMALIZED, 0) != NULL ||
+        freezeRBTreeWithKeys(tree, (FrozenKeyType) (FROZEN_KEY_NORMALIZED + 1), 0) != NULL)
+    {
+        printf("A frozen tree was made with keys the tree doesn't have.\n");
+        passed = 0;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        if (containsFrozenRBTree(frozen, products[i]) != containsRBTree(tree, products[i]))
+        {
+            printf("\"%s\" is found differently by the frozen tree.\n", products[i]->name);
+            passed = 0;
+        }
+    }
+
+    ProductExample *previous = NULL;
+    if (!forEachFrozenRBTree(frozen, checkAscending, &previous))
+    {
+        printf("The frozen tree is not in ascending order.\n");
+        passed = 0;
+    }
+
+    freeFrozenRBTree(frozen);
+    return passed;
+}
+
+/**
+ * Checks that a batched lookup of all the products agrees with looking them up one by one.
+ * @return 1 if the results agree, 0 otherwise
+ */
+int testBatchLookup(RBTree *tree, ProductExample **products)
+{
+    int contains[6];
+    void *found[6];
+    if (!containsBatchRBTree(tree, (void *const *) products, 6, contains) ||
+        !findBatchRBTree(tree, (void *const *) products, 6, found))
+    {
+        return 0;
+    }
+
+    int passed = 1;
+    for (int i = 0; i < 6; i++)
+    {
+        int isInTree = containsRBTree(tree, products[i]);
+        if ((contains[i] != 0) != isInTree || found[i] != (isInTree ? products[i] : NULL))
+        {
+            printf("\"%s\" is found differently by the batched lookup.\n", products[i]->name);
+            passed = 0;
+        }
+    }
+    return passed;
+}
+
+/**
+ * Checks that adding the products next to the last added one (in ascending, then descending name order)
+ * builds the same tree as adding them normally.
+ * @return 1 if the tree is built correctly, 0 otherwise
+ */
+int testFingerInsert(ProductExample **products)
+{
+    RBTree *tree = newRBTree(productComparatorByName, productKeep);
+    setFingerRBTree(tree, 1);
+
+    int passed = 1;
+    for (int i = 0; i < 3; i++)
+    {
+        passed = passed && addToRBTree(tree, products[byName[i]]);
+    }
+    for (int i = 5; i >= 3; i--)
+    {
+        passed = passed && addWithHintRBTree(tree, tree->finger, products[byName[i]]);
+    }
+    passed = passed && !addWithHintRBTree(tree, tree->finger, products[byName[2]]) && tree->size == 6;
+
+    ProductExample *previous = NULL;
+    passed = passed && forEachRBTree(tree, checkAscending, &previous);
+    for (int i = 0; i < 6; i++)
+    {
+        passed = passed && containsRBTree(tree, products[i]);
+    }
+
+    if (!passed)
+    {
+        printf("Adding next to the last added product built a wrong tree.\n");
+    }
+    freeRBTree(tree);
+    return passed;
+}
+
+/**
+ * Checks that the nodes found by lowerBoundRBTree are good hints and walk the products in order.
+ * @return 1 if they are, 0 otherwise
+ */
+int testNodeLookup(ProductExample **products)
+{
+    RBTree *tree = newRBTree(productComparatorByName, productKeep);
+    int passed = 1;
+    for (int i = 0; i < 6; i += 2)
+    {
+        passed = passed && addToRBTree(tree, products[byName[i]]);
+    }
+
+    // Every missing product goes right before the first product that isn't smaller than it.
+    passed = passed && lowerBoundRBTree(tree, products[byName[5]]) == NULL &&
+             addWithHintRBTree(tree, tree->max, products[byName[5]]);
+    for (int i = 1; i < 5; i += 2)
+    {
+        Node *hint = lowerBoundRBTree(tree, products[byName[i]]);
+        passed = passed && hint != NULL && hint->data == products[byName[i + 1]] &&
+                 addWithHintRBTree(tree, hint, products[byName[i]]) &&
+                 lowerBoundRBTree(tree, products[byName[i]])->data == products[byName[i]];
+    }
+
+    int i = 0;
+    Node *first = lowerBoundRBTree(tree, products[byName[0]]);
+    for (Node *node = first; passed && node != NULL; node = nextNodeRBTree(node))
+    {
+        passed = (node->data == products[byName[i++]]);
+    }
+    for (Node *node = tree->max; passed && node != NULL; node = previousNodeRBTree(node))
+    {
+        passed = (node->data == products[byName[--i]]);
+    }
+    passed = passed && i == 0 && tree->size == 6;
+
+    if (!passed)
+    {
+        printf("The nodes found by lowerBoundRBTree are wrong.\n");
+    }
+    freeRBTree(tree);
+    return passed;
+}
+
+/**
+ * Checks that a tree whose nodes live in a file holds the products like a normal tree, also after its nodes
+ * are laid out again, and that its file is deleted right away.
+ * @return 1 if the disk tree works, 0 otherwise
+ */
+int testDiskTree(ProductExample **products)
+{
+    char *path = "ProductExample.rbtree";
+    RBTree *tree = newDiskRBTree(productComparatorByName, productKeep, path, 1 << 20, 4);
+    if (tree == NULL)
+    {
+        printf("Could not create a disk tree.\n");
+        return 0;
+    }
+
+    int passed = 1;
+    for (int i = 0; i < 6; i++)
+    {
+        passed = passed && addToRBTree(tree, products[i]);
+    }
+    refreshDiskRBTreeCache(tree);
+    for (int i = 0; i < 6; i++)
+    {
+        passed = passed && containsRBTree(tree, products[i]);
+    }
+
+    ProductExample *previous = NULL;
+    passed = passed && forEachRBTree(tree, checkAscending, &previous) && tree->size == 6 &&
+             minRBTree(tree) == products[5] && maxRBTree(tree) == products[1];
+
+    FILE *file = fopen(path, "r");
+    if (file != NULL)
+    {
+        fclose(file);
+        passed = 0;
+    }
+    freeRBTree(tree);
+
+    if (!passed)
+    {
+        printf("The disk tree doesn't behave like a normal tree.\n");
+    }
+    return passed;
+}
+
+/**
+ * Adds the numbered products in a scattered order until all of them are in the tree or the tree is full,
+ * checking the tree every time its size reaches a power of 2 (when a disk tree lays its nodes out again).
+ * @return 1 if the checks passed, 0 otherwise
+ */
+int fillWithNumberedProducts(RBTree *tree, char *isIn)
+{
+    int passed = 1;
+    for (int i = 0; passed && i < MANY_PRODUCTS; i++)
+    {
+        // 7919 is prime, so this goes over every number once, out of order.
+        int number = (int) ((i * 7919L) % MANY_PRODUCTS);
+        if (isIn[number])
+        {
+            continue;
+        }
+        ProductExample *pProduct = newNumberedProduct(number);
+        if (!addToRBTree(tree, pProduct))
+        {
+            productFree(pProduct);
+            break;
+        }
+        isIn[number] = 1;
+        if ((tree->size & (tree->size - 1)) == 0)
+        {
+            passed = checkNumberedProducts(tree, isIn);
+        }
+    }
+    return passed && checkNumberedProducts(tree, isIn);
+}
+
+/**
+ * Removes every numbered product in the tree whose number is a multiple of step.
+ * @return 1 if they were all removed, 0 otherwise
+ */
+int removeNumberedProducts(RBTree *tree, char *isIn, int step)
+{
+    int passed = 1;
+    for (int i = 0; passed && i < MANY_PRODUCTS; i += step)
+    {
+        if (isIn[i])
+        {
+            char name[NUMBERED_NAME];
+            snprintf(name, NUMBERED_NAME, "product %05d", i);
+            ProductExample probe = {name, i};
+            passed = removeFromRBTree(tree, &probe);
+            isIn[i] = 0;
+        }
+    }
+    return passed;
+}
+
+/**
+ * Checks that disk trees keep thousands of products through the layouts made as they double and on
+ * request, through removals and additions in between, and when their file is too small for the layout to
+ * leave room on its pages (so the freed nodes are reused).
+ * @return 1 if the disk trees agree with the products they were given, 0 otherwise
+ */
+int testDiskTreeLayout()
+{
+    char isIn[MANY_PRODUCTS];
+    memset(isIn, 0, sizeof(isIn));
+    RBTree *tree = newDiskRBTree(productComparatorByName, productFree, "ProductExample.rbtree", 1 << 24, 4);
+    int passed = tree != NULL && fillWithNumberedProducts(tree, isIn) && tree->size == MANY_PRODUCTS &&
+                 removeNumberedProducts(tree, isIn, 3) && checkNumberedProducts(tree, isIn);
+    if (passed)
+    {
+        refreshDiskRBTreeCache(tree);
+    }
+    passed = passed && checkNumberedProducts(tree, isIn) && fillWithNumberedProducts(tree, isIn) &&
+             tree->size == MANY_PRODUCTS;
+    if (tree != NULL)
+    {
+        freeRBTree(tree);
+    }
+
+    // Only a few pages more than 2048 nodes fill, so the layout at 2048 fills its pages whole and the file
+    // runs out of fresh pages soon after.
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE), nodesPerPage = pageSize / sizeof(Node);
+    memset(isIn, 0, sizeof(isIn));
+    tree = newDiskRBTree(productComparatorByName, productFree, "ProductExample.rbtree",
+                         (2048 / nodesPerPage + 3) * pageSize, 0);
+    passed = passed && tree != NULL && fillWithNumberedProducts(tree, isIn) && tree->size > 2048 &&
+             tree->size < MANY_PRODUCTS;
+    int full = (tree != NULL) ? tree->size : 0;
+    passed = passed && removeNumberedProducts(tree, isIn, 5) && checkNumberedProducts(tree, isIn) &&
+             fillWithNumberedProducts(tree, isIn) && tree->size >= full;
+    if (passed)
+    {
+        refreshDiskRBTreeCache(tree);
+    }
+    passed = passed && checkNumberedProducts(tree, isIn);
+    if (tree != NULL)
+    {
+        freeRBTree(tree);
+    }
+
+    if (!passed)
+    {
+        printf("The disk trees lost track of their products while laying them out.\n");
+    }
+    return passed;
+}
+
+/**
+ * Checks that a tree freed in the background frees all of its products.
+ * @return 1 if every product was freed, 0 otherwise
+ */
+int testAsyncFree(ProductExample **products)
+{
+    RBTree *tree = newRBTree(productComparatorByName, productCountFree);
+    for (int i = 0; i < 6; i++)
+    {
+        addToRBTree(tree, products[i]);
+    }
+
+    freedProducts = 0;
+    freeRBTreeAsync(tree);
+    waitForRBTreeReclaim();
+    if (freedProducts != 6)
+    {
+        printf("Only %d products were freed in the background.\n", freedProducts);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks that a tree that orders the products by normalized keys finds them like the main tree.
+ * @return 1 if the trees agree, 0 otherwise
+ */
+int testKeyExtract(RBTree *tree, ProductExample **products)
+{
+    RBTree *keyed = newRBTree(productComparatorByName, productKeep);
+    int passed = setKeyExtractRBTree(keyed, productKeyByName);
+    for (int i = 0; i < 6; i++)
+    {
+        if (containsRBTree(tree, products[i]))
+        {
+            passed = passed && addToRBTree(keyed, products[i]);
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        passed = passed && (containsRBTree(keyed, products[i]) == containsRBTree(tree, products[i]));
+    }
+    ProductExample *previous = NULL;
+    passed = passed && forEachRBTree(keyed, checkAscending, &previous) && keyed->size == tree->size &&
+             !setKeyExtractRBTree(keyed, NULL);
+
+    // A frozen copy of the tree keeps the normalized keys inline.
+    FrozenRBTree *frozen = freezeRBTree(keyed);
+    passed = passed && frozen != NULL && frozen->keyType == FROZEN_KEY_NORMALIZED;
+    for (int i = 0; passed && i < 6; i++)
+    {
+        passed = (findFrozenRBTree(frozen, products[i]) == (containsRBTree(tree, products[i]) ? products[i] : NULL));
+    }
+    freeFrozenRBTree(frozen);
+
+    if (!passed)
+    {
+        printf("The tree with normalized keys doesn't agree with the tree.\n");
+    }
+    freeRBTree(keyed);
+    return passed;
+}
+
+/**
+ * Checks that a tree with a hash index finds the products like the main tree and rejects duplicates, also
+ * when they are added with a hint.
+ * @return 1 if the trees agree, 0 otherwise
+ */
+int testHashIndex(RBTree *tree, ProductExample **products)
+{
+    RBTree *indexed = newRBTree(productComparatorByName, productKeep);
+    addToRBTree(indexed, products[0]);
+    int passed = enableHashIndexRBTree(indexed, productHashByName);
+    for (int i = 1; i < 6; i++)
+    {
+        if (containsRBTree(tree, products[i]))
+        {
+            passed = passed && addToRBTree(indexed, products[i]);
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        passed = passed && (containsRBTree(indexed, products[i]) == containsRBTree(tree, products[i]));
+    }
+    passed = passed && !addToRBTree(indexed, products[0]) && indexed->size == tree->size;
+
+    // A hinted insertion goes through the index once, whether the hint is used or not.
+    Node *hint = lowerBoundRBTree(indexed, products[5]);
+    passed = passed && addWithHintRBTree(indexed, hint, products[5]) && containsRBTree(indexed, products[5]) &&
+             !addWithHintRBTree(indexed, hint, products[5]) && !addWithHintRBTree(indexed, NULL, products[0]) &&
+             removeFromRBTree(indexed, products[5]) && indexed->size == tree->size;
+
+    RBTreeMemory memory;
+    passed = passed && memoryRBTree(indexed, &memory) && memory.hashIndexBytes > 0 && memory.hashLoadFactor > 0;
+
+    if (!passed)
+    {
+        printf("The tree with a hash index doesn't agree with the tree.\n");
+    }
+    freeRBTree(indexed);
+    return passed;
+}
+
+/**
+ * Checks that the smallest and largest products are found and popped in order, and that removing a product
+ * frees it.
+ * @return 1 if they are, 0 otherwise
+ */
+int testMinMax(ProductExample **products)
+{
+    RBTree *tree = newRBTree(productComparatorByName, productCountFree);
+    for (int i = 0; i < 6; i++)
+    {
+        addToRBTree(tree, products[i]);
+    }
+
+    int passed = minRBTree(tree) == products[byName[0]] && maxRBTree(tree) == products[byName[5]];
+    passed = passed && popMinRBTree(tree) == products[byName[0]] && popMaxRBTree(tree) == products[byName[5]];
+    passed = passed && minRBTree(tree) == products[byName[1]] && maxRBTree(tree) == products[byName[4]];
+
+    freedProducts = 0;
+    passed = passed && removeFromRBTree(tree, products[byName[1]]) && freedProducts == 1 &&
+             !removeFromRBTree(tree, products[byName[0]]) && tree->size == 3;
+    for (int i = 2; i <= 4; i++)
+    {
+        passed = passed && popMinRBTree(tree) == products[byName[i]];
+    }
+    passed = passed && popMinRBTree(tree) == NULL && minRBTree(tree) == NULL && tree->size == 0;
+
+    if (!passed)
+    {
+        printf("The smallest and largest products are not tracked correctly.\n");
+    }
+    freeRBTree(tree);
+    return passed;
+}
+
+/**
+ * Checks that removing and popping many products from a tree with a hash index, whose entries collide in
+ * runs of 16, keeps the tree and the index in agreement, also when removed products are added back.
+ * @return 1 if they agree, 0 otherwise
+ */
+int testHashIndexRemoval()
+{
+    RBTree *tree = newRBTree(productComparatorByName, productFree);
+    char isIn[MANY_PRODUCTS];
+    int passed = enableHashIndexRBTree(tree, productHashByPriceRange);
+    for (int i = 0; passed && i < MANY_PRODUCTS; i++)
+    {
+        // 7919 is prime, so this adds every number once, out of order.
+        int number = (int) ((i * 7919L) % MANY_PRODUCTS);
+        passed = addToRBTree(tree, newNumberedProduct(number));
+        isIn[number] = 1;
+    }
+    passed = passed && checkNumberedProducts(tree, isIn);
+
+    char name[NUMBERED_NAME];
+    ProductExample probe = {name, 0};
+    for (int i = 0; passed && i < MANY_PRODUCTS; i += 3)
+    {
+        snprintf(name, NUMBERED_NAME, "product %05d", i);
+        probe.price = i;
+        passed = removeFromRBTree(tree, &probe) && !removeFromRBTree(tree, &probe);
+        isIn[i] = 0;
+    }
+    passed = passed && checkNumberedProducts(tree, isIn);
+
+    for (int i = 0; passed && i < 100; i++)
+    {
+        ProductExample *min = (ProductExample *) popMinRBTree(tree), *max = (ProductExample *) popMaxRBTree(tree);
+        passed = min != NULL && max != NULL && isIn[(int) min->price] && isIn[(int) max->price];
+        if (passed)
+        {
+            isIn[(int) min->price] = isIn[(int) max->price] = 0;
+            productFree(min);
+            productFree(max);
+        }
+    }
+    passed = passed && checkNumberedProducts(tree, isIn);
+
+    // Products added back must be found through the entries that were shifted back over the removed ones.
+    for (int i = 0; passed && i < MANY_PRODUCTS; i += 6)
+    {
+        passed = addToRBTree(tree, newNumberedProduct(i));
+        isIn[i] = 1;
+    }
+    passed = passed && checkNumberedProducts(tree, isIn);
+
+    if (!passed)
+    {
+        printf("The tree with a hash index lost track of its products while removing them.\n");
+    }
+    freeRBTree(tree);
+    return passed;
+}
+
+/**
+ * Checks that a logged tree recovers its products from its checkpoint and log, also after a torn record,
+ * that a record that can't be read back fails the open without cutting the log, and deletes its files.
+ * @return 1 if the products were recovered, 0 otherwise
+ */
+int testLoggedTree(ProductExample **products)
+{
+    char *directory = "ProductExample.log", *logPath = "ProductExample.log/log";
+    mkdir(directory, 0755);
+    RBTree *tree = openLoggedRBTree(productComparatorByName, productFree, productSerialize, productDeserialize,
+                                    directory, 2, 0);
+    if (tree == NULL)
+    {
+        printf("Could not open a logged tree.\n");
+        return 0;
+    }
+
+    // Only "MacBook Pro" and "iPad" make it to the checkpoint, the rest of the changes stay in the log.
+    int passed = tree->size == 0;
+    for (int i = 0; i < 4; i++)
+    {
+        passed = passed && addToRBTree(tree, productCopy(products[i]));
+    }
+    passed = passed && removeFromRBTree(tree, products[1]) && removeFromRBTree(tree, products[2]) &&
+             checkpointRBTree(tree) && addToRBTree(tree, productCopy(products[5])) &&
+             removeFromRBTree(tree, products[0]) && addToRBTree(tree, productCopy(products[2])) &&
+             syncRBTreeLog(tree);
+    freeRBTree(tree);
+
+    FILE *file = fopen(logPath, "ab");
+    if (file != NULL)
+    {
+        fwrite("torn", 1, 4, file);
+        fclose(file);
+    }
+
+    int expected[6] = {0, 0, 1, 1, 0, 1};
+    for (int round = 0; round < 2 && passed; round++)
+    {
+        tree = openLoggedRBTree(productComparatorByName, productFree, productSerialize, productDeserialize,
+                                directory, 2, 0);
+        passed = tree != NULL && tree->size == 3 + round;
+        for (int i = 0; passed && i < 6; i++)
+        {
+            passed = (containsRBTree(tree, products[i]) == expected[i]);
+        }
+        ProductExample *previous = NULL;
+        passed = passed && forEachRBTree(tree, checkAscending, &previous) &&
+                 ((ProductExample *) maxRBTree(tree))->price == products[2]->price;
+
+        // The record added after the torn one must be recovered too.
+        expected[4] = 1;
+        passed = passed && (round == 1 || addToRBTree(tree, productCopy(products[4])));
+        if (tree != NULL)
+        {
+            freeRBTree(tree);
+        }
+    }
+
+    // "Apple Watch" is the last record of the log, and it may not be dropped when it can't be read back.
+    struct stat status;
+    long long logSize = (stat(logPath, &status) == 0) ? (long long) status.st_size : -1;
+    passed = passed && openLoggedRBTree(productComparatorByName, productFree, productSerialize,
+                                        failingWatchDeserialize, directory, 2, 0) == NULL &&
+             stat(logPath, &status) == 0 && (long long) status.st_size == logSize;
+    tree = passed ? openLoggedRBTree(productComparatorByName, productFree, productSerialize, productDeserialize,
+                                     directory, 2, 0) : NULL;
+    passed = tree != NULL && tree->size == 4;
+    if (tree != NULL)
+    {
+        freeRBTree(tree);
+    }
+
+    remove(logPath);
+    remove("ProductExample.log/checkpoint");
+    remove(directory);
+    if (!passed)
+    {
+        printf("The logged tree didn't recover its products.\n");
+    }
+    return passed;
+}
+
 int main()
 {
     ProductExample **products = getProducts();
@@ -167,6 +985,16 @@ int main()
         }
     }
 
+    if (!testFrozenTree(tree, products) || !testBatchLookup(tree, products) || !testFingerInsert(products) ||
+        !testNodeLookup(products) || !testDiskTree(products) || !testDiskTreeLayout() || !testAsyncFree(products) ||
+        !testKeyExtract(tree, products) || !testHashIndex(tree, products) ||
+        !testMinMax(products) || !testHashIndexRemoval() || !testLoggedTree(products))
+    {
+        printf("Test failed, aborting");
+        freeResources(tree, &products);
+        return 3;
+    }
+
     printf("\nThe number of products in the tree is %d.\n\n", tree->size);
     forEachRBTree(tree, printProduct, NULL);
     freeResources(tree, &products);
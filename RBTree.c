@@ -11,8 +11,21 @@
 #define RBTREE_RBTREE_H
 
 // ------------------------------ includes ------------------------------
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
 
 // -------------------------- const definitions -------------------------
 // Number constants.
@@ -20,6 +33,42 @@
 #define FALSE 0
 #define SUCCESS 1
 #define FAILURE 0
+// Result of a hinted insertion whose item doesn't belong next to the hint.
+#define HINT_MISSED (-1)
+
+// Frozen trees prefetch the slots this many levels below the current one on every step of a search.
+#define FROZEN_PREFETCH_DEPTH 4
+#define FROZEN_PREFETCH_SPAN (1 << FROZEN_PREFETCH_DEPTH)
+
+// Number of searches a batched lookup advances together.
+#define BATCH_WIDTH 16
+
+// Permissions of the backing files of disk trees.
+#define DISK_FILE_MODE 0644
+// A disk tree refreshes its layout and cached pages when its size reaches this, and then every time it doubles.
+#define DISK_FIRST_REFRESH 1024
+// A new layout fills this percent of every page, leaving room for sons added to its nodes later.
+#define DISK_LAYOUT_FILL 75
+// Marks of the slots of an arena that hold no node of the tree, or whose node was already moved.
+#define SLOT_FREE SIZE_MAX
+#define SLOT_MOVED (SIZE_MAX - 1)
+
+// Number of nodes the background reclaimer handles before it yields the CPU.
+#define RECLAIM_CHUNK 4096
+
+// The first bytes of checkpoint and log files.
+#define CHECKPOINT_MAGIC 0x43544252u
+#define LOG_MAGIC 0x4c544252u
+// Kinds of the records of a log (checkpoints hold insertion records only).
+#define RECORD_INSERT 1
+#define RECORD_REMOVE 2
+// Returned by readRecord when a whole record can't be read for a reason other than a crash.
+#define RECORD_ERROR (-1)
+// A record is a 4 byte size and a 1 byte kind, the item, and a 4 byte checksum of the kind and the item.
+#define RECORD_HEADER 5
+#define RECORD_CHECKSUM 4
+// Written records are kept in memory until they take this many bytes (or their group is synced).
+#define LOG_WRITE_CHUNK (64 * 1024)
 
 // -------------------------------- code --------------------------------
 
@@ -51,6 +100,39 @@ typedef int (*forEachFunc)(const void *object, void *args);
  */
 typedef void (*FreeFunc)(void *data);
 
+/**
+ * a function that maps an item to a number that keeps the order of the items: if a < b then
+ * key(a) <= key(b). items with different keys are ordered by their keys alone.
+ * @data: a pointer to an item of the tree.
+ * @return: the normalized key of the item.
+ */
+typedef uint64_t (*KeyExtractFunc)(const void *data);
+
+/**
+ * a function that hashes the tree items. equal items (by compFunc) must have equal hashes.
+ * @data: a pointer to an item of the tree.
+ * @return: the hash of the item.
+ */
+typedef size_t (*HashFunc)(const void *data);
+
+/**
+ * a function that writes an item to a buffer, for trees with a write-ahead log.
+ * @data: a pointer to an item of the tree.
+ * @buffer: where to write the item.
+ * @capacity: the size of buffer in bytes.
+ * @return: the size of the written item in bytes. if it's larger than capacity, nothing needs to be written
+ * and the function is called again with a large enough buffer.
+ */
+typedef size_t (*SerializeFunc)(const void *data, void *buffer, size_t capacity);
+
+/**
+ * a function that rebuilds an item written by a SerializeFunc.
+ * @buffer: the written item.
+ * @size: its size in bytes.
+ * @return: a new item (freed with the tree's FreeFunc), or NULL on failure.
+ */
+typedef void *(*DeserializeFunc)(const void *buffer, size_t size);
+
 /**
  * a node of the tree.
  */
@@ -59,9 +141,90 @@ typedef struct Node
     struct Node *parent, *left, *right;
     Color color;
     void *data;
+    uint64_t key; // the normalized key of data (only used if the tree has a KeyExtractFunc).
 
 } Node;
 
+/**
+ * the file-backed memory mapping that holds the nodes of a disk tree. the mapping is split to pages, and a
+ * new node is put on the page of its parent while there is room. every time the tree doubles, the nodes are
+ * laid out again so every page holds whole top parts of subtrees (see layoutArena).
+ */
+typedef struct NodeArena
+{
+    char *base;
+    size_t pageSize, pageCount, usedPages;
+    int nodesPerPage;
+    unsigned short *pageUse;
+    Node *freeNodes;
+    int fd;
+    int cachedPages, lockedCount;
+    size_t *lockedPages;
+    unsigned char *isLocked;
+    int nextRefresh;
+} NodeArena;
+
+/**
+ * an entry of a hash index: an item of the tree and its hash (data is NULL in empty entries).
+ */
+typedef struct HashEntry
+{
+    size_t hash;
+    void *data;
+} HashEntry;
+
+/**
+ * an open addressing hash table of the items of a tree, for exact lookups that don't descend the tree.
+ * collisions are resolved by linear probing, and the table doubles before it gets too full.
+ */
+typedef struct HashIndex
+{
+    HashEntry *entries;
+    size_t capacity, count;
+    HashFunc hashFunc;
+    size_t pendingHash; // the hash of the item being added.
+} HashIndex;
+
+/**
+ * the write-ahead log of a tree. changes are encoded to the buffer and written and synced in groups. both
+ * the checkpoint and the log start with the generation of the checkpoint, which grows with every
+ * checkpoint, so a log that was already folded into a newer checkpoint is never replayed over it.
+ */
+typedef struct RBTreeLog
+{
+    SerializeFunc serialize;
+    DeserializeFunc deserialize;
+    char *directory, *logPath, *checkpointPath, *tempPath;
+    int fd;
+    uint64_t generation;
+    unsigned char *buffer;
+    size_t length, capacity;
+    int pending, groupSize;
+    size_t logBytes, checkpointBytes;
+    int failed; // set when a change couldn't be logged, so the log no longer matches the tree.
+} RBTreeLog;
+
+/**
+ * how much memory a tree takes, to decide whether a hash index is worth it.
+ */
+typedef struct RBTreeMemory
+{
+    size_t treeBytes, hashIndexBytes;
+    double hashLoadFactor;
+} RBTreeMemory;
+
+/**
+ * the nodes of a tree that was handed to the background reclaimer. the nodes of heap trees are freed from
+ * root, and the items of disk trees are freed in order from next before their file is dropped.
+ */
+typedef struct ReclaimJob
+{
+    Node *root, *next;
+    FreeFunc freeFunc;
+    NodeArena *arena;
+    struct ReclaimJob *nextJob;
+} ReclaimJob;
+
 /**
  * represents the tree
  */
@@ -71,8 +234,40 @@ typedef struct RBTree
     CompareFunc compFunc;
     FreeFunc freeFunc;
     int size;
+    Node *finger; // the last added node.
+    int useFinger;
+    KeyExtractFunc keyFunc; // NULL unless set with setKeyExtractRBTree.
+    HashIndex *hashIndex; // NULL unless made with enableHashIndexRBTree.
+    NodeArena *arena; // NULL unless the nodes live in a file (see newDiskRBTree).
+    Node *min, *max; // the first and last nodes in ascending order.
+    RBTreeLog *log; // NULL unless opened with openLoggedRBTree.
 } RBTree;
 
+// the kind of key a frozen tree keeps inline next to its data pointers. (FROZEN_KEY_NORMALIZED holds the
+// keys of the tree's KeyExtractFunc, and is chosen by freezeRBTree itself)
+typedef enum FrozenKeyType
+{
+    FROZEN_KEY_NONE,
+    FROZEN_KEY_INT,
+    FROZEN_KEY_DOUBLE,
+    FROZEN_KEY_NORMALIZED
+} FrozenKeyType;
+
+/**
+ * an immutable snapshot of a tree, stored as a contiguous array in Eytzinger (BFS) order.
+ * slot 1 is the root and the children of slot k are 2k and 2k + 1 (slot 0 is unused).
+ */
+typedef struct FrozenRBTree
+{
+    void **data;
+    void *keys;
+    size_t keyOffset;
+    FrozenKeyType keyType;
+    CompareFunc compFunc;
+    KeyExtractFunc keyFunc; // the keys of FROZEN_KEY_NORMALIZED.
+    int size;
+} FrozenRBTree;
+
 /**
  * constructs a new RBTree with the given CompareFunc.
  * comp: a function two compare two variables.
@@ -94,294 +289,2706 @@ RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc)
     tree->compFunc = compFunc;
     tree->freeFunc = freeFunc;
     tree->size = 0;
+    tree->finger = NULL;
+    tree->useFinger = FALSE;
+    tree->keyFunc = NULL;
+    tree->hashIndex = NULL;
+    tree->arena = NULL;
+    tree->min = tree->max = NULL;
+    tree->log = NULL;
 
     return tree;
 }
 
-/*
- * Helper function that creates and returns a new node (needs to be freed).
- * (Assumes data is valid, parent can be null and position is only used if parent isn't null)
- */
-static Node *createNode(void *data, Node *parent, int position)
+// Helper function that unmaps and frees the given arena. (Its file was already deleted, so it goes away too)
+static void freeArena(NodeArena *arena)
 {
-    Node *newNode = (Node *) malloc(sizeof(Node));
-    if (newNode == NULL)
-    {
-        return NULL;
-    }
-
-    newNode->left = newNode->right = NULL;
-    newNode->parent = parent;
-    newNode->color = RED;
-    newNode->data = data;
-
-    if (parent != NULL)
+    if (arena->base != NULL)
     {
-        if (position > 0)
-        {
-            parent->right = newNode;
-        }
-        else
+        for (int i = 0; i < arena->lockedCount; i++)
         {
-            parent->left = newNode;
+            munlock(arena->base + arena->lockedPages[i] * arena->pageSize, arena->pageSize);
         }
+        munmap(arena->base, arena->pageCount * arena->pageSize);
     }
-
-    return newNode;
+    if (arena->fd >= 0)
+    {
+        close(arena->fd);
+    }
+    free(arena->pageUse);
+    free(arena->lockedPages);
+    free(arena->isLocked);
+    free(arena);
 }
 
-// Rotates the tree to the right around the given node.
-static void rotateRight(RBTree *tree, Node *node)
+// Helper function that maps a new sparse file of the given capacity for the nodes of a disk tree.
+static NodeArena *newArena(const char *path, size_t capacity, int cachedPages)
 {
-    Node *head = node->left;
-    Node *left = node->left = head->right;
+    NodeArena *arena = (NodeArena *) calloc(1, sizeof(NodeArena));
+    if (arena == NULL)
+    {
+        return NULL;
+    }
 
-    if (left != NULL)
+    arena->fd = -1;
+    arena->pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    arena->pageCount = capacity / arena->pageSize;
+    arena->nodesPerPage = (int) (arena->pageSize / sizeof(Node));
+    arena->cachedPages = (cachedPages > 0) ? cachedPages : 0;
+    arena->nextRefresh = DISK_FIRST_REFRESH;
+    arena->pageUse = (unsigned short *) calloc(arena->pageCount + 1, sizeof(unsigned short));
+    arena->isLocked = (unsigned char *) calloc(arena->pageCount + 1, sizeof(unsigned char));
+    arena->lockedPages = (size_t *) malloc(sizeof(size_t) * (arena->cachedPages + 1));
+    if (arena->pageCount == 0 || arena->pageUse == NULL || arena->isLocked == NULL ||
+        arena->lockedPages == NULL)
     {
-        left->parent = node;
+        freeArena(arena);
+        return NULL;
     }
-    head->parent = node->parent;
 
-    if (head->parent == NULL)
+    // The file is deleted right away, so it is reclaimed even if the process dies without freeing the tree.
+    arena->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, DISK_FILE_MODE);
+    if (arena->fd >= 0)
     {
-        tree->root = head;
+        unlink(path);
     }
-    else
+    if (arena->fd < 0 || ftruncate(arena->fd, (off_t) (arena->pageCount * arena->pageSize)) != 0)
     {
-        Node *parent = head->parent;
-        if (parent->left == node)
-        {
-            parent->left = head;
-        }
-        else
-        {
-            parent->right = head;
-        }
+        freeArena(arena);
+        return NULL;
     }
 
-    head->right = node;
-    node->parent = head;
+    void *base = mmap(NULL, arena->pageCount * arena->pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, arena->fd, 0);
+    if (base == MAP_FAILED)
+    {
+        freeArena(arena);
+        return NULL;
+    }
+    arena->base = (char *) base;
+    return arena;
 }
 
-// Rotates the tree to the left around the given node.
-static void rotateLeft(RBTree *tree, Node *node)
+// Helper function that returns the index of the page that holds the given node of the arena.
+static size_t pageOfNode(const NodeArena *arena, const Node *node)
 {
-    Node *head = node->right;
-    Node *right = node->right = head->left;
-
-    if (right != NULL)
-    {
-        right->parent = node;
-    }
-    head->parent = node->parent;
+    return (size_t) ((const char *) node - arena->base) / arena->pageSize;
+}
 
-    if (head->parent == NULL)
-    {
-        tree->root = head;
-    }
-    else
+/*
+ * Helper function that returns room for a new node in the arena, or NULL if it is full. The node goes on
+ * the page of its parent if it has room, otherwise on the last opened page, so the subtrees started there
+ * share it. Once that page is full too a fresh one is opened, and nodes freed earlier are only reused when
+ * there are no fresh pages left.
+ */
+static Node *allocateArenaNode(NodeArena *arena, Node *parent)
+{
+    size_t page = (parent != NULL) ? pageOfNode(arena, parent) : arena->usedPages;
+    if (page == arena->usedPages || arena->pageUse[page] >= arena->nodesPerPage)
     {
-        Node *parent = head->parent;
-        if (parent->left == node)
-        {
-            parent->left = head;
-        }
-        else
+        page = arena->usedPages - 1;
+        if (arena->usedPages == 0 || arena->pageUse[page] >= arena->nodesPerPage)
         {
-            parent->right = head;
+            if (arena->usedPages == arena->pageCount)
+            {
+                Node *node = arena->freeNodes;
+                if (node != NULL)
+                {
+                    arena->freeNodes = node->right;
+                }
+                return node;
+            }
+            page = arena->usedPages++;
         }
     }
+    return (Node *) (arena->base + page * arena->pageSize) + arena->pageUse[page]++;
+}
 
-    head->left = node;
-    node->parent = head;
+// Helper function that returns the index of the slot of a node of the arena, counting nodesPerPage slots per page.
+static size_t slotOfNode(const NodeArena *arena, const Node *node)
+{
+    size_t page = pageOfNode(arena, node);
+    return page * arena->nodesPerPage + (size_t) (node - (const Node *) (arena->base + page * arena->pageSize));
 }
 
-// Balances the given tree after the insertion of the given node. (Assumes valid input)
-static void balanceTree(RBTree *tree, Node *newNode)
+// Helper function that returns the node in the given slot of the arena.
+static Node *nodeInSlot(const NodeArena *arena, size_t slot)
 {
-    Node *parent = newNode->parent;
-    if (parent == NULL)
+    return (Node *) (arena->base + (slot / arena->nodesPerPage) * arena->pageSize) + slot % arena->nodesPerPage;
+}
+
+// Helper function that returns where the given node of the arena moves to (NULL stays NULL).
+static Node *movedNode(const NodeArena *arena, const size_t *target, const Node *node)
+{
+    return (node == NULL) ? NULL : nodeInSlot(arena, target[slotOfNode(arena, node)]);
+}
+
+/*
+ * Helper function that works out the new slot of every node of a disk tree, so every page holds subtrees:
+ * the top levels of the tree fill the first page, and the sons left out of a page start the next pages,
+ * level by level. A search then crosses to a new page about once every log2(fill) levels. Returns the
+ * number of slots used, or 0 on failure.
+ */
+static size_t planArenaLayout(RBTree *tree, size_t *target, size_t fill)
+{
+    NodeArena *arena = tree->arena;
+    size_t size = (size_t) tree->size, queueCapacity = 2 * fill + 2, blockHead = 0, blockTail = 0, used = 0;
+    Node **blocks = (Node **) malloc(sizeof(Node *) * (size + 1));
+    Node **queue = (Node **) malloc(sizeof(Node *) * queueCapacity);
+    if (blocks == NULL || queue == NULL)
     {
-        newNode->color = BLACK;
+        free(blocks);
+        free(queue);
+        return 0;
     }
-    else if (parent->color == RED)
-    {
-        Node *grandpa = parent->parent;
-        int isRightParent = (parent == grandpa->right);
-        Node *uncle = isRightParent ? grandpa->left : grandpa->right;
 
-        if (uncle != NULL && uncle->color == RED)
-        {
-            parent->color = uncle->color = BLACK;
-            grandpa->color = RED;
-            balanceTree(tree, grandpa);
-        }
-        else
+    // Every block is a subtree laid out level by level until its page is full. Its sons that didn't fit
+    // become blocks of their own, and a small block leaves the rest of its page to the next one.
+    blocks[blockTail++] = tree->root;
+    while (blockHead < blockTail)
+    {
+        size_t head = 0, tail = 0;
+        queue[tail++] = blocks[blockHead++];
+        while (head < tail)
         {
-            int isRightSon = (newNode == parent->right);
-            if (isRightSon && !isRightParent)
-            {
-                rotateLeft(tree, parent);
-                rotateRight(tree, grandpa);
-                newNode->color = BLACK;
-            }
-            else if (!isRightSon && isRightParent)
+            Node *current = queue[head++];
+            target[slotOfNode(arena, current)] = (used / fill) * arena->nodesPerPage + used % fill;
+            used++;
+            if (current->left != NULL)
             {
-                rotateRight(tree, parent);
-                rotateLeft(tree, grandpa);
-                newNode->color = BLACK;
+                queue[tail++] = current->left;
             }
-            else if (isRightParent)
+            if (current->right != NULL)
             {
-                rotateLeft(tree, grandpa);
-                parent->color = BLACK;
+                queue[tail++] = current->right;
             }
-            else
+            if (used % fill == 0)
             {
-                rotateRight(tree, grandpa);
-                parent->color = BLACK;
+                break;
             }
-
-            grandpa->color = RED;
+        }
+        while (head < tail)
+        {
+            blocks[blockTail++] = queue[head++];
         }
     }
+    free(blocks);
+    free(queue);
+    return used;
 }
 
-// Creates and inserts a new node with the given data to the correct place in the given tree. (Assumes valid input)
-static int insertNodeToTree(RBTree *tree, void *data)
+/*
+ * Helper function that moves the nodes of a disk tree to the layout of planArenaLayout. The pointers are
+ * redirected first, and then the nodes are moved along the cycles of the permutation, so no copy of the
+ * tree is needed. Pages are only filled to DISK_LAYOUT_FILL percent when the arena has room for it, so
+ * nodes added later fit on the page of their parent. (Nodes held outside the tree move as well)
+ */
+static void layoutArena(RBTree *tree)
 {
-    int compareResult = 0;
-    Node *parent = tree->root, *son = tree->root;
-    while (son != NULL)
+    NodeArena *arena = tree->arena;
+    size_t size = (size_t) tree->size, slots = arena->usedPages * arena->nodesPerPage;
+    size_t fill = (size_t) arena->nodesPerPage * DISK_LAYOUT_FILL / 100;
+    if (fill == 0 || (size + fill - 1) / fill > arena->pageCount)
     {
-        compareResult = tree->compFunc(data, son->data);
-        if (compareResult == 0)
+        fill = (size_t) arena->nodesPerPage;
+    }
+    size_t *target = (size_t *) malloc(sizeof(size_t) * (slots + 1));
+    if (size == 0 || target == NULL)
+    {
+        free(target);
+        return;
+    }
+    for (size_t slot = 0; slot < slots; slot++)
+    {
+        target[slot] = SLOT_FREE;
+    }
+    if (planArenaLayout(tree, target, fill) != size)
+    {
+        free(target);
+        return;
+    }
+
+    for (size_t slot = 0; slot < slots; slot++)
+    {
+        if (target[slot] != SLOT_FREE)
         {
-            return FAILURE;
+            Node *node = nodeInSlot(arena, slot);
+            node->parent = movedNode(arena, target, node->parent);
+            node->left = movedNode(arena, target, node->left);
+            node->right = movedNode(arena, target, node->right);
         }
-        else
+    }
+    tree->root = movedNode(arena, target, tree->root);
+    tree->min = movedNode(arena, target, tree->min);
+    tree->max = movedNode(arena, target, tree->max);
+    tree->finger = movedNode(arena, target, tree->finger);
+
+    for (size_t slot = 0; slot < slots; slot++)
+    {
+        if (target[slot] == SLOT_FREE || target[slot] == SLOT_MOVED)
         {
-            parent = son;
-            son = (compareResult > 0) ? son->right : son->left;
+            continue;
         }
+        Node moving = *nodeInSlot(arena, slot);
+        size_t to = target[slot];
+        target[slot] = SLOT_MOVED;
+        while (to < slots && target[to] != SLOT_FREE && target[to] != SLOT_MOVED)
+        {
+            Node next = *nodeInSlot(arena, to);
+            size_t nextTo = target[to];
+            target[to] = SLOT_MOVED;
+            *nodeInSlot(arena, to) = moving;
+            moving = next;
+            to = nextTo;
+        }
+        *nodeInSlot(arena, to) = moving;
     }
+    free(target);
 
-    Node *newNode = createNode(data, parent, compareResult);
-    if (newNode == NULL)
+    size_t usedPages = (size + fill - 1) / fill;
+    for (size_t page = 0; page < arena->usedPages || page < usedPages; page++)
     {
-        return FAILURE;
+        size_t count = 0;
+        if (page < usedPages)
+        {
+            count = (page + 1 < usedPages) ? fill : size - page * fill;
+        }
+        arena->pageUse[page] = (unsigned short) count;
     }
-
-    tree->size++;
-    balanceTree(tree, newNode);
-    return SUCCESS;
+    arena->usedPages = usedPages;
+    arena->freeNodes = NULL;
 }
 
-/**
- * add an item to the tree
- * @param tree: the tree to add an item to.
- * @param data: item to add to the tree.
- * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+/*
+ * Helper function that lays the nodes of a disk tree out again (see layoutArena) and keeps the pages
+ * holding the top levels of the tree in RAM. The pages are collected by walking the tree level by level
+ * from the root, and locked (or just read ahead if locking is not allowed). The previously cached pages are
+ * released first.
  */
-int addToRBTree(RBTree *tree, void *data)
+static void refreshArenaCache(RBTree *tree)
 {
-    if (tree == NULL || data == NULL)
+    NodeArena *arena = tree->arena;
+    for (int i = 0; i < arena->lockedCount; i++)
     {
-        return FAILURE;
+        munlock(arena->base + arena->lockedPages[i] * arena->pageSize, arena->pageSize);
+        arena->isLocked[arena->lockedPages[i]] = FALSE;
     }
-
-    if (tree->size == 0)
+    arena->lockedCount = 0;
+    layoutArena(tree);
+    if (arena->cachedPages == 0 || tree->root == NULL)
     {
-        Node *newNode = createNode(data, NULL, 0);
-        if (newNode == NULL)
-        {
-            return FAILURE;
-        }
-
-        tree->root = newNode;
-        tree->size++;
-        balanceTree(tree, newNode);
-        return SUCCESS;
+        return;
     }
 
-    return insertNodeToTree(tree, data);
-}
+    size_t capacity = (size_t) arena->cachedPages * arena->nodesPerPage, head = 0, tail = 0;
+    Node **queue = (Node **) malloc(sizeof(Node *) * capacity);
+    if (queue == NULL)
+    {
+        return;
+    }
 
-// Helper recursive function for the contains function.
-static int containsHelper(RBTree *tree, void *data, Node *current)
-{
-    if (current == NULL)
+    queue[tail++] = tree->root;
+    while (head < tail && arena->lockedCount < arena->cachedPages)
     {
-        return FALSE;
+        Node *current = queue[head++];
+        size_t page = pageOfNode(arena, current);
+        if (!arena->isLocked[page])
+        {
+            char *address = arena->base + page * arena->pageSize;
+            if (mlock(address, arena->pageSize) != 0)
+            {
+                posix_madvise(address, arena->pageSize, POSIX_MADV_WILLNEED);
+            }
+            arena->isLocked[page] = TRUE;
+            arena->lockedPages[arena->lockedCount++] = page;
+        }
+
+        if (current->left != NULL && tail < capacity)
+        {
+            queue[tail++] = current->left;
+        }
+        if (current->right != NULL && tail < capacity)
+        {
+            queue[tail++] = current->right;
+        }
     }
-    return (tree->compFunc(data, current->data) == 0) ||
-           containsHelper(tree, data, current->left) ||
-           containsHelper(tree, data, current->right);
+    free(queue);
 }
 
 /**
- * check whether the tree contains this item.
- * @param tree: the tree to add an item to.
- * @param data: item to check.
- * @return: 0 if the item is not in the tree, other if it is.
+ * constructs a new RBTree whose nodes live in a memory mapped file instead of the heap, for trees whose nodes
+ * don't fit in RAM. only the nodes move to the file: the items are still allocated by the caller, so the
+ * items themselves must fit in memory (this pays off for small items, or items that live in a file of
+ * their own). every time the tree doubles (and in refreshDiskRBTreeCache), the nodes are laid out again so
+ * every page holds the top levels of subtrees, and a search touches about one page per log2 of the number
+ * of nodes on a page (instead of one page per level). nodes added in between go on the page of their parent
+ * when it has room. the layout moves nodes, so a Node pointer of a disk tree (like from lowerBoundRBTree)
+ * is only valid until the next change.
+ * @param path: a new file for the nodes (truncated if it exists). the file is deleted right away and only
+ * lives on as long as the tree, since it holds pointers that mean nothing outside this process.
+ * @param capacity: the maximal size of the backing file in bytes. the file is sparse, so only the pages in
+ * use take disk space.
+ * @param cachedPages: the number of pages holding the top levels of the tree to keep in RAM (0 for none).
  */
-int containsRBTree(RBTree *tree, void *data)
+RBTree *newDiskRBTree(CompareFunc compFunc, FreeFunc freeFunc, const char *path, size_t capacity, int cachedPages)
 {
-    if (tree == NULL || data == NULL)
+    if (path == NULL)
     {
-        return FALSE;
+        return NULL;
+    }
+
+    RBTree *tree = newRBTree(compFunc, freeFunc);
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    tree->arena = newArena(path, capacity, cachedPages);
+    if (tree->arena == NULL)
+    {
+        free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+/**
+ * lay out the nodes of a disk tree again and recollect the pages that are kept in RAM, after changes moved
+ * its top levels. (this also happens by itself every time the size of the tree doubles)
+ * @param tree: the disk tree.
+ */
+void refreshDiskRBTreeCache(RBTree *tree)
+{
+    if (tree != NULL && tree->arena != NULL)
+    {
+        refreshArenaCache(tree);
+    }
+}
+
+/*
+ * Helper function that creates and returns a new node (needs to be freed).
+ * (Assumes data is valid, parent can be null and position is only used if parent isn't null)
+ */
+static Node *createNode(RBTree *tree, void *data, uint64_t key, Node *parent, int position)
+{
+    Node *newNode = (tree->arena != NULL) ? allocateArenaNode(tree->arena, parent) : (Node *) malloc(sizeof(Node));
+    if (newNode == NULL)
+    {
+        return NULL;
+    }
+
+    newNode->left = newNode->right = NULL;
+    newNode->parent = parent;
+    newNode->color = RED;
+    newNode->data = data;
+    newNode->key = key;
+
+    if (parent != NULL)
+    {
+        if (position > 0)
+        {
+            parent->right = newNode;
+        }
+        else
+        {
+            parent->left = newNode;
+        }
+    }
+
+    return newNode;
+}
+
+// Helper function that returns the index of the first entry to probe for the given hash in the table.
+static size_t hashSlot(const HashIndex *index, size_t hash)
+{
+    // Fibonacci hashing, so weak hash functions still spread over the whole table.
+    return (size_t) (((uint64_t) hash * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (index->capacity - 1);
+}
+
+// Helper function that returns the item of the index that is equal to data, or NULL if there is none.
+static void *findInHashIndex(const RBTree *tree, const void *data, size_t hash)
+{
+    const HashIndex *index = tree->hashIndex;
+    for (size_t slot = hashSlot(index, hash);; slot = (slot + 1) & (index->capacity - 1))
+    {
+        const HashEntry *entry = &index->entries[slot];
+        if (entry->data == NULL)
+        {
+            return NULL;
+        }
+        if (entry->hash == hash && tree->compFunc(data, entry->data) == 0)
+        {
+            return entry->data;
+        }
+    }
+}
+
+// Helper function that puts an item in the index. (Assumes there is room and the item isn't there yet)
+static void insertToHashIndex(HashIndex *index, void *data, size_t hash)
+{
+    size_t slot = hashSlot(index, hash);
+    while (index->entries[slot].data != NULL)
+    {
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    index->entries[slot].hash = hash;
+    index->entries[slot].data = data;
+    index->count++;
+}
+
+// Helper function that moves the index to a table of the given capacity (a power of 2). Returns 0 on failure.
+static int resizeHashIndex(HashIndex *index, size_t capacity)
+{
+    HashEntry *entries = (HashEntry *) calloc(capacity, sizeof(HashEntry));
+    if (entries == NULL)
+    {
+        return FAILURE;
+    }
+
+    HashEntry *oldEntries = index->entries;
+    size_t oldCapacity = index->capacity;
+    index->entries = entries;
+    index->capacity = capacity;
+    index->count = 0;
+    for (size_t slot = 0; slot < oldCapacity; slot++)
+    {
+        if (oldEntries[slot].data != NULL)
+        {
+            insertToHashIndex(index, oldEntries[slot].data, oldEntries[slot].hash);
+        }
+    }
+    free(oldEntries);
+    return SUCCESS;
+}
+
+/*
+ * Helper function that checks that data isn't in the hash index yet and makes room for it there, before
+ * it is added to the tree. Its hash is kept for linkNewNode. Returns 0 if data is already in the tree or
+ * there is no memory, other otherwise (and if the tree has no hash index).
+ */
+static int prepareHashIndex(RBTree *tree, const void *data)
+{
+    HashIndex *index = tree->hashIndex;
+    if (index == NULL)
+    {
+        return SUCCESS;
+    }
+
+    index->pendingHash = index->hashFunc(data);
+    if (findInHashIndex(tree, data, index->pendingHash) != NULL)
+    {
+        return FAILURE;
+    }
+
+    // The table stays at most 3/4 full, so the probes stay short.
+    if (4 * (index->count + 1) > 3 * index->capacity)
+    {
+        return resizeHashIndex(index, 2 * index->capacity);
+    }
+    return SUCCESS;
+}
+
+/*
+ * Helper function that takes the given item out of the hash index. The entries after it that would be
+ * closer to their first probe in its place are moved back, so the probe sequences stay unbroken without
+ * leaving markers in the table. (Assumes the item is in the index)
+ */
+static void removeFromHashIndex(HashIndex *index, const void *data)
+{
+    size_t mask = index->capacity - 1, hole = hashSlot(index, index->hashFunc(data));
+    while (index->entries[hole].data != data)
+    {
+        hole = (hole + 1) & mask;
+    }
+
+    for (size_t slot = (hole + 1) & mask; index->entries[slot].data != NULL; slot = (slot + 1) & mask)
+    {
+        // The entry can fill the hole unless its first probe lies after the hole (cyclically).
+        size_t home = hashSlot(index, index->entries[slot].hash);
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            index->entries[hole] = index->entries[slot];
+            hole = slot;
+        }
+    }
+    index->entries[hole].data = NULL;
+    index->count--;
+}
+
+// Helper function that frees the given hash index (can be NULL).
+static void freeHashIndex(HashIndex *index)
+{
+    if (index != NULL)
+    {
+        free(index->entries);
+        free(index);
+    }
+}
+
+// Rotates the tree to the right around the given node.
+static void rotateRight(RBTree *tree, Node *node)
+{
+    Node *head = node->left;
+    Node *left = node->left = head->right;
+
+    if (left != NULL)
+    {
+        left->parent = node;
+    }
+    head->parent = node->parent;
+
+    if (head->parent == NULL)
+    {
+        tree->root = head;
+    }
+    else
+    {
+        Node *parent = head->parent;
+        if (parent->left == node)
+        {
+            parent->left = head;
+        }
+        else
+        {
+            parent->right = head;
+        }
+    }
+
+    head->right = node;
+    node->parent = head;
+}
+
+// Rotates the tree to the left around the given node.
+static void rotateLeft(RBTree *tree, Node *node)
+{
+    Node *head = node->right;
+    Node *right = node->right = head->left;
+
+    if (right != NULL)
+    {
+        right->parent = node;
+    }
+    head->parent = node->parent;
+
+    if (head->parent == NULL)
+    {
+        tree->root = head;
+    }
+    else
+    {
+        Node *parent = head->parent;
+        if (parent->left == node)
+        {
+            parent->left = head;
+        }
+        else
+        {
+            parent->right = head;
+        }
+    }
+
+    head->left = node;
+    node->parent = head;
+}
+
+// Balances the given tree after the insertion of the given node. (Assumes valid input)
+static void balanceTree(RBTree *tree, Node *newNode)
+{
+    Node *parent = newNode->parent;
+    if (parent == NULL)
+    {
+        newNode->color = BLACK;
+    }
+    else if (parent->color == RED)
+    {
+        Node *grandpa = parent->parent;
+        int isRightParent = (parent == grandpa->right);
+        Node *uncle = isRightParent ? grandpa->left : grandpa->right;
+
+        if (uncle != NULL && uncle->color == RED)
+        {
+            parent->color = uncle->color = BLACK;
+            grandpa->color = RED;
+            balanceTree(tree, grandpa);
+        }
+        else
+        {
+            int isRightSon = (newNode == parent->right);
+            if (isRightSon && !isRightParent)
+            {
+                rotateLeft(tree, parent);
+                rotateRight(tree, grandpa);
+                newNode->color = BLACK;
+            }
+            else if (!isRightSon && isRightParent)
+            {
+                rotateRight(tree, parent);
+                rotateLeft(tree, grandpa);
+                newNode->color = BLACK;
+            }
+            else if (isRightParent)
+            {
+                rotateLeft(tree, grandpa);
+                parent->color = BLACK;
+            }
+            else
+            {
+                rotateRight(tree, grandpa);
+                parent->color = BLACK;
+            }
+
+            grandpa->color = RED;
+        }
+    }
+}
+
+// Appends a change to the log of a logged tree (defined with the rest of the log below).
+static void logChange(RBTree *tree, int kind, const void *data);
+
+/*
+ * Helper function that creates a new node with the given data as a son of the given parent (or as the root
+ * if parent is null) and balances the tree. (Assumes the position is free and keeps the tree sorted)
+ */
+static int linkNewNode(RBTree *tree, void *data, uint64_t key, Node *parent, int position)
+{
+    Node *newNode = createNode(tree, data, key, parent, position);
+    if (newNode == NULL)
+    {
+        return FAILURE;
+    }
+
+    // A new node is a new extreme only if it hangs on the outer side of the old one.
+    if (parent == NULL)
+    {
+        tree->root = tree->min = tree->max = newNode;
+    }
+    else if (parent == tree->min && position <= 0)
+    {
+        tree->min = newNode;
+    }
+    else if (parent == tree->max && position > 0)
+    {
+        tree->max = newNode;
+    }
+    tree->size++;
+    tree->finger = newNode;
+    if (tree->hashIndex != NULL)
+    {
+        insertToHashIndex(tree->hashIndex, data, tree->hashIndex->pendingHash);
+    }
+    balanceTree(tree, newNode);
+
+    if (tree->arena != NULL && tree->size >= tree->arena->nextRefresh)
+    {
+        tree->arena->nextRefresh *= 2;
+        refreshArenaCache(tree);
+    }
+    logChange(tree, RECORD_INSERT, data);
+    return SUCCESS;
+}
+
+// Helper function that returns the normalized key of data, or 0 if the tree doesn't use keys.
+static uint64_t keyOf(const RBTree *tree, const void *data)
+{
+    return (tree->keyFunc != NULL) ? tree->keyFunc(data) : 0;
+}
+
+/*
+ * Helper function that compares data (whose normalized key is given) to the item of the node, like
+ * compFunc. Different keys decide right away, so compFunc is only called when the keys are equal.
+ */
+static int compareToNode(const RBTree *tree, const void *data, uint64_t key, const Node *node)
+{
+    if (key != node->key)
+    {
+        return (key > node->key) ? 1 : -1;
+    }
+    return tree->compFunc(data, node->data);
+}
+
+// Creates and inserts a new node with the given data to the correct place in the given tree. (Assumes valid input)
+static int insertNodeToTree(RBTree *tree, void *data, uint64_t key)
+{
+    int compareResult = 0;
+    Node *parent = tree->root, *son = tree->root;
+    while (son != NULL)
+    {
+        compareResult = compareToNode(tree, data, key, son);
+        if (compareResult == 0)
+        {
+            return FAILURE;
+        }
+        else
+        {
+            parent = son;
+            son = (compareResult > 0) ? son->right : son->left;
+        }
+    }
+
+    return linkNewNode(tree, data, key, parent, compareResult);
+}
+
+// Helper function that returns the next node in ascending order, or NULL if node is the last one.
+static Node *successorNode(Node *node)
+{
+    if (node->right != NULL)
+    {
+        node = node->right;
+        while (node->left != NULL)
+        {
+            node = node->left;
+        }
+        return node;
+    }
+
+    while (node->parent != NULL && node == node->parent->right)
+    {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+// Helper function that returns the previous node in ascending order, or NULL if node is the first one.
+static Node *predecessorNode(Node *node)
+{
+    if (node->left != NULL)
+    {
+        node = node->left;
+        while (node->right != NULL)
+        {
+            node = node->right;
+        }
+        return node;
+    }
+
+    while (node->parent != NULL && node == node->parent->left)
+    {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+/*
+ * Helper function that inserts data between the hint and its neighbour without descending from the root.
+ * Takes at most two comparisons. Returns HINT_MISSED if data doesn't belong next to the hint.
+ * (Assumes valid input)
+ */
+static int insertNextToNode(RBTree *tree, Node *hint, void *data, uint64_t key)
+{
+    int compareResult = compareToNode(tree, data, key, hint);
+    if (compareResult == 0)
+    {
+        return FAILURE;
+    }
+
+    // The new node goes in the free son of the hint that faces data, or else in the free son of the
+    // neighbour that faces the hint (it has one, since the neighbour is the extreme of the hint's subtree).
+    Node *neighbour;
+    if (compareResult > 0)
+    {
+        neighbour = (hint == tree->max) ? NULL : successorNode(hint);
+    }
+    else
+    {
+        neighbour = (hint == tree->min) ? NULL : predecessorNode(hint);
+    }
+    if (neighbour != NULL)
+    {
+        int neighbourResult = compareToNode(tree, data, key, neighbour);
+        if (neighbourResult == 0)
+        {
+            return FAILURE;
+        }
+        if ((neighbourResult > 0) == (compareResult > 0))
+        {
+            return HINT_MISSED;
+        }
+    }
+
+    Node *hintSon = (compareResult > 0) ? hint->right : hint->left;
+    if (hintSon == NULL)
+    {
+        return linkNewNode(tree, data, key, hint, compareResult);
+    }
+    return linkNewNode(tree, data, key, neighbour, (compareResult > 0) ? -1 : 1);
+}
+
+/*
+ * Helper function that adds an item with the given key to the tree, next to the finger if it's on or with
+ * a descent from the root. (Assumes prepareHashIndex already succeeded for the item)
+ */
+static int insertPreparedItem(RBTree *tree, void *data, uint64_t key)
+{
+    if (tree->size == 0)
+    {
+        return linkNewNode(tree, data, key, NULL, 0);
+    }
+
+    if (tree->useFinger && tree->finger != NULL)
+    {
+        int result = insertNextToNode(tree, tree->finger, data, key);
+        if (result != HINT_MISSED)
+        {
+            return result;
+        }
+    }
+    return insertNodeToTree(tree, data, key);
+}
+
+/**
+ * add an item to the tree
+ * @param tree: the tree to add an item to.
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int addToRBTree(RBTree *tree, void *data)
+{
+    if (tree == NULL || data == NULL || !prepareHashIndex(tree, data))
+    {
+        return FAILURE;
+    }
+    return insertPreparedItem(tree, data, keyOf(tree, data));
+}
+
+/**
+ * make the tree order its items by a normalized key before comparing them with compFunc. every node stores
+ * the key of its item, so a search compares numbers and only calls compFunc when the keys are equal.
+ * @param tree: the tree to configure (must be empty).
+ * @param keyFunc: a function that maps every item to a key that keeps their order (NULL to stop using keys).
+ * @return: 0 on failure (if the tree isn't empty), other on success.
+ */
+int setKeyExtractRBTree(RBTree *tree, KeyExtractFunc keyFunc)
+{
+    if (tree == NULL || tree->size != 0)
+    {
+        return FAILURE;
+    }
+    tree->keyFunc = keyFunc;
+    return SUCCESS;
+}
+
+/**
+ * add an item to the tree, starting the search for its place from the given node. if the item belongs
+ * right next to the hint (for example after the last added node when adding in ascending order), it is
+ * added with at most two comparisons. otherwise it is added like in addToRBTree.
+ * @param tree: the tree to add an item to.
+ * @param hint: a node of the tree near the place of the item, for example from lowerBoundRBTree (may be NULL).
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int addWithHintRBTree(RBTree *tree, Node *hint, void *data)
+{
+    if (tree == NULL || data == NULL || !prepareHashIndex(tree, data))
+    {
+        return FAILURE;
+    }
+
+    uint64_t key = keyOf(tree, data);
+    if (hint != NULL && tree->size != 0)
+    {
+        int result = insertNextToNode(tree, hint, data, key);
+        if (result != HINT_MISSED)
+        {
+            return result;
+        }
+    }
+    return insertPreparedItem(tree, data, key);
+}
+
+/**
+ * turn the last insertion finger on or off. while it is on, addToRBTree first tries to add the item next to
+ * the last added node (tree->finger), so adding items in (nearly) sorted order skips the descent.
+ * @param tree: the tree to configure.
+ * @param useFinger: 0 to turn the finger off, other to turn it on.
+ */
+void setFingerRBTree(RBTree *tree, int useFinger)
+{
+    if (tree != NULL)
+    {
+        tree->useFinger = useFinger;
+    }
+}
+
+// Helper function that returns the node holding an item equal to data, or NULL. (Assumes valid input)
+static Node *findNode(RBTree *tree, const void *data)
+{
+    uint64_t key = keyOf(tree, data);
+    Node *current = tree->root;
+    while (current != NULL)
+    {
+        int compareResult = compareToNode(tree, data, key, current);
+        if (compareResult == 0)
+        {
+            return current;
+        }
+        current = (compareResult > 0) ? current->right : current->left;
+    }
+    return NULL;
+}
+
+/**
+ * check whether the tree contains this item.
+ * @param tree: the tree to add an item to.
+ * @param data: item to check.
+ * @return: 0 if the item is not in the tree, other if it is.
+ */
+int containsRBTree(RBTree *tree, void *data)
+{
+    if (tree == NULL || data == NULL)
+    {
+        return FALSE;
+    }
+    if (tree->hashIndex != NULL)
+    {
+        return findInHashIndex(tree, data, tree->hashIndex->hashFunc(data)) != NULL;
+    }
+    return findNode(tree, data) != NULL;
+}
+
+/**
+ * find the node of the first item of the tree that isn't smaller than data, to use as the hint of
+ * addWithHintRBTree for items near data, or to walk the tree in order from it with nextNodeRBTree and
+ * previousNodeRBTree. a node stays valid until its own item is removed (in a disk tree, until the next change).
+ * @param tree: the tree to search.
+ * @param data: the item to look for.
+ * @return: the node (its item is node->data), or NULL if every item is smaller than data.
+ */
+Node *lowerBoundRBTree(RBTree *tree, const void *data)
+{
+    if (tree == NULL || data == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t key = keyOf(tree, data);
+    Node *current = tree->root, *bound = NULL;
+    while (current != NULL)
+    {
+        int compareResult = compareToNode(tree, data, key, current);
+        if (compareResult == 0)
+        {
+            return current;
+        }
+        if (compareResult < 0)
+        {
+            bound = current;
+            current = current->left;
+        }
+        else
+        {
+            current = current->right;
+        }
+    }
+    return bound;
+}
+
+/**
+ * @param node: a node of a tree.
+ * @return: the node of the next item in ascending order, or NULL if node is the last one (or NULL).
+ */
+Node *nextNodeRBTree(Node *node)
+{
+    return (node == NULL) ? NULL : successorNode(node);
+}
+
+/**
+ * @param node: a node of a tree.
+ * @return: the node of the previous item in ascending order, or NULL if node is the first one (or NULL).
+ */
+Node *previousNodeRBTree(Node *node)
+{
+    return (node == NULL) ? NULL : predecessorNode(node);
+}
+
+// Helper function that puts the subtree of son in the place of the subtree of node.
+static void replaceSubtree(RBTree *tree, Node *node, Node *son)
+{
+    if (node->parent == NULL)
+    {
+        tree->root = son;
+    }
+    else if (node == node->parent->left)
+    {
+        node->parent->left = son;
+    }
+    else
+    {
+        node->parent->right = son;
+    }
+
+    if (son != NULL)
+    {
+        son->parent = node->parent;
+    }
+}
+
+// Helper function that returns the color of the node, where missing nodes are black.
+static Color colorOf(const Node *node)
+{
+    return (node == NULL) ? BLACK : node->color;
+}
+
+/*
+ * Balances the given tree after the removal of a black node, which left the subtree of node (that may be
+ * missing, so its parent is given) one black node short.
+ */
+static void balanceAfterRemoval(RBTree *tree, Node *node, Node *parent)
+{
+    while (node != tree->root && colorOf(node) == BLACK)
+    {
+        if (node == parent->left)
+        {
+            Node *sibling = parent->right;
+            if (sibling->color == RED)
+            {
+                sibling->color = BLACK;
+                parent->color = RED;
+                rotateLeft(tree, parent);
+                sibling = parent->right;
+            }
+
+            if (colorOf(sibling->left) == BLACK && colorOf(sibling->right) == BLACK)
+            {
+                sibling->color = RED;
+                node = parent;
+                parent = node->parent;
+            }
+            else
+            {
+                if (colorOf(sibling->right) == BLACK)
+                {
+                    sibling->left->color = BLACK;
+                    sibling->color = RED;
+                    rotateRight(tree, sibling);
+                    sibling = parent->right;
+                }
+                sibling->color = parent->color;
+                parent->color = sibling->right->color = BLACK;
+                rotateLeft(tree, parent);
+                node = tree->root;
+            }
+        }
+        else
+        {
+            Node *sibling = parent->left;
+            if (sibling->color == RED)
+            {
+                sibling->color = BLACK;
+                parent->color = RED;
+                rotateRight(tree, parent);
+                sibling = parent->left;
+            }
+
+            if (colorOf(sibling->left) == BLACK && colorOf(sibling->right) == BLACK)
+            {
+                sibling->color = RED;
+                node = parent;
+                parent = node->parent;
+            }
+            else
+            {
+                if (colorOf(sibling->left) == BLACK)
+                {
+                    sibling->right->color = BLACK;
+                    sibling->color = RED;
+                    rotateLeft(tree, sibling);
+                    sibling = parent->left;
+                }
+                sibling->color = parent->color;
+                parent->color = sibling->left->color = BLACK;
+                rotateRight(tree, parent);
+                node = tree->root;
+            }
+        }
+    }
+
+    if (node != NULL)
+    {
+        node->color = BLACK;
+    }
+}
+
+/*
+ * Helper function that unlinks the given node from the tree, balances it and frees the node (but not its
+ * item). A node with two sons is replaced by its successor node itself rather than by a copy of its item,
+ * so every other node keeps holding the same item. (Assumes the node is in the tree)
+ */
+static void removeNode(RBTree *tree, Node *node)
+{
+    if (node == tree->min)
+    {
+        tree->min = successorNode(node);
+    }
+    if (node == tree->max)
+    {
+        tree->max = predecessorNode(node);
+    }
+    if (node == tree->finger)
+    {
+        tree->finger = NULL;
+    }
+    if (tree->hashIndex != NULL)
+    {
+        removeFromHashIndex(tree->hashIndex, node->data);
+    }
+
+    void *data = node->data;
+    Color removedColor = node->color;
+    Node *son, *sonParent;
+    if (node->left == NULL || node->right == NULL)
+    {
+        son = (node->left != NULL) ? node->left : node->right;
+        sonParent = node->parent;
+        replaceSubtree(tree, node, son);
+    }
+    else
+    {
+        Node *successor = node->right;
+        while (successor->left != NULL)
+        {
+            successor = successor->left;
+        }
+
+        removedColor = successor->color;
+        son = successor->right;
+        sonParent = successor;
+        if (successor->parent != node)
+        {
+            sonParent = successor->parent;
+            replaceSubtree(tree, successor, successor->right);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+
+        replaceSubtree(tree, node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+        successor->color = node->color;
+    }
+
+    if (removedColor == BLACK)
+    {
+        balanceAfterRemoval(tree, son, sonParent);
+    }
+
+    tree->size--;
+    if (tree->arena != NULL)
+    {
+        node->right = tree->arena->freeNodes;
+        tree->arena->freeNodes = node;
+    }
+    else
+    {
+        free(node);
+    }
+    logChange(tree, RECORD_REMOVE, data);
+}
+
+/**
+ * remove an item from the tree and free it with the tree's FreeFunc.
+ * @param tree: the tree to remove an item from.
+ * @param data: an item equal to the one to remove.
+ * @return: 0 on failure, other on success. (if the item is not in the tree - failure).
+ */
+int removeFromRBTree(RBTree *tree, void *data)
+{
+    if (tree == NULL || data == NULL)
+    {
+        return FAILURE;
+    }
+
+    Node *node = findNode(tree, data);
+    if (node == NULL)
+    {
+        return FAILURE;
+    }
+
+    void *item = node->data;
+    removeNode(tree, node);
+    tree->freeFunc(item);
+    return SUCCESS;
+}
+
+/**
+ * @param tree: the tree.
+ * @return: the smallest item of the tree in O(1), or NULL if the tree is empty.
+ */
+void *minRBTree(RBTree *tree)
+{
+    return (tree == NULL || tree->min == NULL) ? NULL : tree->min->data;
+}
+
+/**
+ * @param tree: the tree.
+ * @return: the largest item of the tree in O(1), or NULL if the tree is empty.
+ */
+void *maxRBTree(RBTree *tree)
+{
+    return (tree == NULL || tree->max == NULL) ? NULL : tree->max->data;
+}
+
+/**
+ * remove the smallest item from the tree and return it (it's not freed). the next smallest item is found
+ * from the removed one, in amortized O(1).
+ * @param tree: the tree.
+ * @return: the removed item, or NULL if the tree is empty.
+ */
+void *popMinRBTree(RBTree *tree)
+{
+    if (tree == NULL || tree->min == NULL)
+    {
+        return NULL;
+    }
+
+    void *item = tree->min->data;
+    removeNode(tree, tree->min);
+    return item;
+}
+
+/**
+ * remove the largest item from the tree and return it (it's not freed). the next largest item is found
+ * from the removed one, in amortized O(1).
+ * @param tree: the tree.
+ * @return: the removed item, or NULL if the tree is empty.
+ */
+void *popMaxRBTree(RBTree *tree)
+{
+    if (tree == NULL || tree->max == NULL)
+    {
+        return NULL;
+    }
+
+    void *item = tree->max->data;
+    removeNode(tree, tree->max);
+    return item;
+}
+
+/*
+ * Helper function for the batched lookups. Up to BATCH_WIDTH searches advance together in lanes, and each
+ * level of a search takes two steps: the first prefetches the data of the (already prefetched) node and
+ * the second compares it and prefetches the next node. Every prefetch has a whole round of the other
+ * lanes to complete. A lane whose search ends takes the next key. Either result array may be NULL.
+ * Trees with normalized keys skip the first step, since their nodes hold what the comparison needs, and
+ * trees with a hash index don't descend at all. (Assumes valid input)
+ */
+static void findBatchHelper(RBTree *tree, void *const *keys, int n, int *contains, void **found)
+{
+    if (tree->hashIndex != NULL)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            void *item = findInHashIndex(tree, keys[i], tree->hashIndex->hashFunc(keys[i]));
+            if (contains != NULL)
+            {
+                contains[i] = (item != NULL);
+            }
+            if (found != NULL)
+            {
+                found[i] = item;
+            }
+        }
+        return;
+    }
+
+    Node *lanes[BATCH_WIDTH];
+    uint64_t laneNormalizedKeys[BATCH_WIDTH];
+    int laneItems[BATCH_WIDTH], isReady[BATCH_WIDTH];
+    int width = (n < BATCH_WIDTH) ? n : BATCH_WIDTH;
+    for (int lane = 0; lane < width; lane++)
+    {
+        lanes[lane] = tree->root;
+        laneItems[lane] = lane;
+        laneNormalizedKeys[lane] = keyOf(tree, keys[lane]);
+        isReady[lane] = (tree->keyFunc != NULL);
+    }
+
+    int next = width, active = width;
+    while (active > 0)
+    {
+        for (int lane = 0; lane < width; lane++)
+        {
+            int item = laneItems[lane];
+            Node *current = lanes[lane];
+            if (item < 0)
+            {
+                continue;
+            }
+
+            if (current != NULL)
+            {
+                if (!isReady[lane])
+                {
+                    __builtin_prefetch(current->data);
+                    isReady[lane] = TRUE;
+                    continue;
+                }
+
+                int compareResult = compareToNode(tree, keys[item], laneNormalizedKeys[lane], current);
+                if (compareResult != 0)
+                {
+                    current = lanes[lane] = (compareResult > 0) ? current->right : current->left;
+                    isReady[lane] = (tree->keyFunc != NULL);
+                    if (current != NULL)
+                    {
+                        __builtin_prefetch(current);
+                        continue;
+                    }
+                }
+            }
+
+            if (contains != NULL)
+            {
+                contains[item] = (current != NULL);
+            }
+            if (found != NULL)
+            {
+                found[item] = (current != NULL) ? current->data : NULL;
+            }
+
+            isReady[lane] = (tree->keyFunc != NULL);
+            if (next < n)
+            {
+                lanes[lane] = tree->root;
+                laneNormalizedKeys[lane] = keyOf(tree, keys[next]);
+                laneItems[lane] = next++;
+            }
+            else
+            {
+                laneItems[lane] = -1;
+                active--;
+            }
+        }
+    }
+}
+
+/**
+ * check whether the tree contains each of the given items. the searches are interleaved, so the memory
+ * latency of one search is hidden behind the work of the others.
+ * @param tree: the tree to search.
+ * @param keys: the items to check.
+ * @param n: the number of items to check.
+ * @param results: filled with 0 for every item that is not in the tree and with other values for the rest.
+ * @return: 0 on failure, other on success.
+ */
+int containsBatchRBTree(RBTree *tree, void *const *keys, int n, int *results)
+{
+    if (tree == NULL || keys == NULL || results == NULL || n < 0)
+    {
+        return FAILURE;
+    }
+    findBatchHelper(tree, keys, n, results, NULL);
+    return SUCCESS;
+}
+
+/**
+ * find the items of the tree that are equal to each of the given items (see containsBatchRBTree).
+ * @param tree: the tree to search.
+ * @param keys: the items to look for.
+ * @param n: the number of items to look for.
+ * @param results: filled with the item of the tree equal to each key, or NULL if there is none.
+ * @return: 0 on failure, other on success.
+ */
+int findBatchRBTree(RBTree *tree, void *const *keys, int n, void **results)
+{
+    if (tree == NULL || keys == NULL || results == NULL || n < 0)
+    {
+        return FAILURE;
+    }
+    findBatchHelper(tree, keys, n, NULL, results);
+    return SUCCESS;
+}
+
+// Helper recursive function for the forEach function.
+static int forEachHelper(forEachFunc func, void *args, Node *current)
+{
+    if (current == NULL)
+    {
+        return TRUE;
+    }
+    return forEachHelper(func, args, current->left) && func(current->data, args) &&
+           forEachHelper(func, args, current->right);
+}
+
+// Helper function that asks the kernel to start reading the page of the given node if it isn't the current one.
+static void readAheadArenaNode(NodeArena *arena, const Node *node, size_t currentPage)
+{
+    if (node != NULL && pageOfNode(arena, node) != currentPage)
+    {
+        posix_madvise(arena->base + pageOfNode(arena, node) * arena->pageSize, arena->pageSize, POSIX_MADV_WILLNEED);
+    }
+}
+
+/*
+ * Helper function for the forEach function of disk trees. The walk follows the parent links instead of
+ * recursing, and every time it enters a page it asks the kernel to read ahead the pages of the subtrees
+ * hanging below the node, so the following pages stream in while the current one is processed.
+ */
+static int forEachArenaHelper(RBTree *tree, forEachFunc func, void *args)
+{
+    NodeArena *arena = tree->arena;
+    Node *current = tree->root;
+    size_t currentPage = arena->pageCount;
+    while (current != NULL && current->left != NULL)
+    {
+        current = current->left;
+    }
+
+    while (current != NULL)
+    {
+        size_t page = pageOfNode(arena, current);
+        if (page != currentPage)
+        {
+            currentPage = page;
+            readAheadArenaNode(arena, current->right, currentPage);
+            readAheadArenaNode(arena, current->parent, currentPage);
+        }
+
+        if (!func(current->data, args))
+        {
+            return FAILURE;
+        }
+        current = successorNode(current);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Activate a function on each item of the tree. the order is an ascending order. if one of the activations of the
+ * function returns 0, the process stops.
+ * @param tree: the tree with all the items.
+ * @param func: the function to activate on all items.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachRBTree(RBTree *tree, forEachFunc func, void *args)
+{
+    if (tree == NULL || func == NULL)
+    {
+        return FAILURE;
+    }
+    if (tree->arena != NULL)
+    {
+        return forEachArenaHelper(tree, func, args);
+    }
+    return forEachHelper(func, args, tree->root);
+}
+
+// Helper forEach function that puts the item in the hash index given in args.
+static int indexItem(const void *object, void *args)
+{
+    HashIndex *index = (HashIndex *) args;
+    insertToHashIndex(index, (void *) object, index->hashFunc(object));
+    return TRUE;
+}
+
+/**
+ * keep a hash index of the items next to the tree, so containsRBTree, the batched lookups and the check
+ * for duplicates in addToRBTree take O(1) expected time. ordered operations keep using the tree.
+ * @param tree: the tree to index.
+ * @param hashFunc: a function that hashes the items (equal items must have equal hashes).
+ * @return: 0 on failure, other on success.
+ */
+int enableHashIndexRBTree(RBTree *tree, HashFunc hashFunc)
+{
+    if (tree == NULL || hashFunc == NULL || tree->hashIndex != NULL)
+    {
+        return FAILURE;
+    }
+
+    HashIndex *index = (HashIndex *) malloc(sizeof(HashIndex));
+    if (index == NULL)
+    {
+        return FAILURE;
+    }
+
+    // The smallest power of 2 that keeps the table at most half full.
+    size_t capacity = 16;
+    while (capacity < 2 * (size_t) tree->size)
+    {
+        capacity *= 2;
+    }
+    index->entries = (HashEntry *) calloc(capacity, sizeof(HashEntry));
+    if (index->entries == NULL)
+    {
+        free(index);
+        return FAILURE;
+    }
+
+    index->capacity = capacity;
+    index->count = 0;
+    index->hashFunc = hashFunc;
+    forEachRBTree(tree, indexItem, index);
+    tree->hashIndex = index;
+    return SUCCESS;
+}
+
+/**
+ * stop keeping a hash index next to the tree and free it.
+ * @param tree: the indexed tree.
+ */
+void disableHashIndexRBTree(RBTree *tree)
+{
+    if (tree != NULL)
+    {
+        freeHashIndex(tree->hashIndex);
+        tree->hashIndex = NULL;
+    }
+}
+
+/**
+ * report how much memory the tree and its hash index take.
+ * @param tree: the tree.
+ * @param memory: filled with the sizes in bytes (hashIndexBytes is 0 without a hash index) and the
+ * fraction of the hash index entries in use.
+ * @return: 0 on failure, other on success.
+ */
+int memoryRBTree(RBTree *tree, RBTreeMemory *memory)
+{
+    if (tree == NULL || memory == NULL)
+    {
+        return FAILURE;
+    }
+
+    memory->treeBytes = sizeof(RBTree) + (size_t) tree->size * sizeof(Node);
+    memory->hashIndexBytes = 0;
+    memory->hashLoadFactor = 0;
+    if (tree->hashIndex != NULL)
+    {
+        memory->hashIndexBytes = sizeof(HashIndex) + tree->hashIndex->capacity * sizeof(HashEntry);
+        memory->hashLoadFactor = (double) tree->hashIndex->count / (double) tree->hashIndex->capacity;
+    }
+    return SUCCESS;
+}
+
+// Helper function that returns the checksum (FNV-1a) of the kind and item of a record.
+static uint32_t recordChecksum(unsigned char kind, const unsigned char *item, size_t size)
+{
+    uint32_t hash = (2166136261u ^ kind) * 16777619u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ item[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Helper function that makes room for extra more bytes in the buffer of the log. Returns 0 on failure.
+static int reserveLogBuffer(RBTreeLog *log, size_t extra)
+{
+    if (log->capacity - log->length >= extra)
+    {
+        return SUCCESS;
+    }
+
+    size_t capacity = (log->length + extra > 2 * log->capacity) ? log->length + extra : 2 * log->capacity;
+    unsigned char *buffer = (unsigned char *) realloc(log->buffer, capacity);
+    if (buffer == NULL)
+    {
+        return FAILURE;
+    }
+    log->buffer = buffer;
+    log->capacity = capacity;
+    return SUCCESS;
+}
+
+/*
+ * Helper function that appends a record of the given kind and item to the buffer of the log. The item is
+ * serialized right into the buffer, and again after growing it if it didn't fit.
+ */
+static int encodeRecord(RBTreeLog *log, unsigned char kind, const void *data)
+{
+    if (!reserveLogBuffer(log, RECORD_HEADER + RECORD_CHECKSUM))
+    {
+        return FAILURE;
+    }
+
+    size_t room = log->capacity - log->length - RECORD_HEADER - RECORD_CHECKSUM;
+    size_t size = log->serialize(data, log->buffer + log->length + RECORD_HEADER, room);
+    if (size > UINT32_MAX)
+    {
+        return FAILURE;
+    }
+    if (size > room)
+    {
+        if (!reserveLogBuffer(log, RECORD_HEADER + size + RECORD_CHECKSUM))
+        {
+            return FAILURE;
+        }
+        log->serialize(data, log->buffer + log->length + RECORD_HEADER, size);
+    }
+
+    unsigned char *record = log->buffer + log->length;
+    uint32_t recordSize = (uint32_t) size, checksum = recordChecksum(kind, record + RECORD_HEADER, size);
+    memcpy(record, &recordSize, sizeof(uint32_t));
+    record[sizeof(uint32_t)] = kind;
+    memcpy(record + RECORD_HEADER + size, &checksum, sizeof(uint32_t));
+    log->length += RECORD_HEADER + size + RECORD_CHECKSUM;
+    return SUCCESS;
+}
+
+// Helper function that writes the whole given range to fd, retrying partial writes.
+static int writeAll(int fd, const unsigned char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            return FAILURE;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+    return SUCCESS;
+}
+
+// Helper function that writes the records in the buffer of the log to the log file (without syncing it).
+static int flushLog(RBTreeLog *log)
+{
+    if (!writeAll(log->fd, log->buffer, log->length))
+    {
+        return FAILURE;
+    }
+    log->logBytes += log->length;
+    log->length = 0;
+    return SUCCESS;
+}
+
+// Helper function that writes the records in the buffer of the log and syncs them, committing their group.
+static int commitLog(RBTreeLog *log)
+{
+    if (log->pending == 0 && log->length == 0)
+    {
+        return SUCCESS;
+    }
+    log->pending = 0;
+    return flushLog(log) && fdatasync(log->fd) == 0;
+}
+
+// Helper function that syncs the given directory, so the files created or renamed in it survive a crash.
+static int syncDirectory(const char *directory)
+{
+    int fd = open(directory, O_RDONLY);
+    if (fd < 0)
+    {
+        return FAILURE;
+    }
+    int result = (fsync(fd) == 0);
+    close(fd);
+    return result;
+}
+
+// Helper function that replaces the log file with an empty log of the current generation.
+static int startLog(RBTreeLog *log)
+{
+    if (log->fd >= 0)
+    {
+        close(log->fd);
+    }
+    log->fd = open(log->logPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, DISK_FILE_MODE);
+    if (log->fd < 0)
+    {
+        return FAILURE;
+    }
+
+    uint32_t magic = LOG_MAGIC;
+    unsigned char header[sizeof(uint32_t) + sizeof(uint64_t)];
+    memcpy(header, &magic, sizeof(uint32_t));
+    memcpy(header + sizeof(uint32_t), &log->generation, sizeof(uint64_t));
+    if (!writeAll(log->fd, header, sizeof(header)) || fdatasync(log->fd) != 0)
+    {
+        return FAILURE;
+    }
+    log->logBytes = sizeof(header);
+    return syncDirectory(log->directory);
+}
+
+// The log whose buffer collects the records of a checkpoint, and the checkpoint file they go to.
+typedef struct CheckpointWriter
+{
+    RBTreeLog *log;
+    int fd;
+} CheckpointWriter;
+
+// Helper forEach function that adds a record of the item to the checkpoint, writing it out in chunks.
+static int checkpointItem(const void *object, void *args)
+{
+    CheckpointWriter *writer = (CheckpointWriter *) args;
+    RBTreeLog *log = writer->log;
+    if (!encodeRecord(log, RECORD_INSERT, object))
+    {
+        return FALSE;
+    }
+    if (log->length >= LOG_WRITE_CHUNK)
+    {
+        if (!writeAll(writer->fd, log->buffer, log->length))
+        {
+            return FALSE;
+        }
+        log->length = 0;
+    }
+    return TRUE;
+}
+
+/*
+ * Helper function that writes all the items of the tree in order to a checkpoint of the next generation and
+ * starts a new log. The checkpoint is written to a temporary file that replaces the old one only once it's
+ * synced, and the log is started over only once the replacement is synced, so a crash leaves either the old
+ * checkpoint with its log or the new one. (a log that failed is
+ * dropped instead of committed, since the checkpoint makes it unneeded)
+ */
+static int writeCheckpoint(RBTree *tree)
+{
+    RBTreeLog *log = tree->log;
+    if (!log->failed && !commitLog(log))
+    {
+        return FAILURE;
+    }
+    log->length = 0;
+    log->pending = 0;
+
+    int fd = open(log->tempPath, O_WRONLY | O_CREAT | O_TRUNC, DISK_FILE_MODE);
+    if (fd < 0)
+    {
+        return FAILURE;
+    }
+
+    uint32_t magic = CHECKPOINT_MAGIC;
+    uint64_t generation = log->generation + 1, count = (uint64_t) tree->size;
+    unsigned char header[sizeof(uint32_t) + 2 * sizeof(uint64_t)];
+    memcpy(header, &magic, sizeof(uint32_t));
+    memcpy(header + sizeof(uint32_t), &generation, sizeof(uint64_t));
+    memcpy(header + sizeof(uint32_t) + sizeof(uint64_t), &count, sizeof(uint64_t));
+    CheckpointWriter writer = {log, fd};
+    int result = writeAll(fd, header, sizeof(header)) && forEachRBTree(tree, checkpointItem, &writer) &&
+                 writeAll(fd, log->buffer, log->length) && fsync(fd) == 0;
+    log->length = 0;
+    if (close(fd) != 0 || !result || rename(log->tempPath, log->checkpointPath) != 0)
+    {
+        unlink(log->tempPath);
+        return FAILURE;
+    }
+
+    // The rename must reach the disk before the log is emptied, or a crash could leave the old checkpoint
+    // next to an empty log and lose every change made since it.
+    log->generation = generation;
+    if (!syncDirectory(log->directory) || !startLog(log))
+    {
+        log->failed = TRUE;
+        return FAILURE;
+    }
+    log->failed = FALSE;
+    return SUCCESS;
+}
+
+/*
+ * Appends a change to the log of a logged tree (nothing happens for other trees). A full group is committed,
+ * and followed by a checkpoint if the log grew too big, which makes this change wait for the whole tree to be
+ * written and synced. If the change can't be logged, the log is marked as failed and stops logging until the
+ * next checkpoint.
+ */
+static void logChange(RBTree *tree, int kind, const void *data)
+{
+    RBTreeLog *log = tree->log;
+    if (log == NULL || log->failed)
+    {
+        return;
+    }
+
+    if (!encodeRecord(log, (unsigned char) kind, data))
+    {
+        log->failed = TRUE;
+    }
+    else if (++log->pending >= log->groupSize)
+    {
+        if (!commitLog(log))
+        {
+            log->failed = TRUE;
+        }
+        else if (log->checkpointBytes > 0 && log->logBytes >= log->checkpointBytes)
+        {
+            writeCheckpoint(tree);
+        }
+    }
+    else if (log->length >= LOG_WRITE_CHUNK && !flushLog(log))
+    {
+        log->failed = TRUE;
+    }
+}
+
+// Helper function that commits what is left of the given log (if it didn't fail), closes it and frees it.
+static void closeLog(RBTreeLog *log)
+{
+    if (log == NULL)
+    {
+        return;
+    }
+    if (log->fd >= 0)
+    {
+        if (!log->failed)
+        {
+            commitLog(log);
+        }
+        close(log->fd);
+    }
+    free(log->directory);
+    free(log->logPath);
+    free(log->checkpointPath);
+    free(log->tempPath);
+    free(log->buffer);
+    free(log);
+}
+
+// The trees waiting for the background reclaimer, and the number of trees it hasn't finished yet.
+static pthread_mutex_t reclaimLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaimQueued = PTHREAD_COND_INITIALIZER, reclaimDone = PTHREAD_COND_INITIALIZER;
+static ReclaimJob *reclaimHead = NULL, *reclaimTail = NULL;
+static int reclaimPending = 0, isReclaimerRunning = FALSE;
+
+/*
+ * Helper function that frees up to budget nodes of a heap tree with their items and returns the root of
+ * what is left. Instead of recursing, it rotates the left son of the root up until there is none and then
+ * frees the root, so it needs no stack and can stop anywhere.
+ */
+static Node *freeNodesBounded(Node *root, FreeFunc freeFunc, size_t budget)
+{
+    while (root != NULL && budget > 0)
+    {
+        Node *left = root->left;
+        if (left != NULL)
+        {
+            root->left = left->right;
+            left->right = root;
+            root = left;
+        }
+        else
+        {
+            Node *right = root->right;
+            freeFunc(root->data);
+            free(root);
+            root = right;
+        }
+        budget--;
+    }
+    return root;
+}
+
+/*
+ * Helper function that frees up to budget items of a disk tree in order, starting from next, and returns
+ * the node to continue from. The nodes themselves are left untouched, since they go away with the file.
+ */
+static Node *freeArenaItemsBounded(Node *next, FreeFunc freeFunc, size_t budget)
+{
+    for (; next != NULL && budget > 0; budget--)
+    {
+        Node *current = next;
+        next = successorNode(current);
+        freeFunc(current->data);
+    }
+    return next;
+}
+
+// Helper function that returns the first node of the tree in ascending order, or NULL if it's empty.
+static Node *firstNode(Node *root)
+{
+    while (root != NULL && root->left != NULL)
+    {
+        root = root->left;
+    }
+    return root;
+}
+
+// Helper function that frees up to budget nodes of the job. Returns 0 when the job is done, other otherwise.
+static int reclaimChunk(ReclaimJob *job, size_t budget)
+{
+    if (job->arena != NULL)
+    {
+        job->next = freeArenaItemsBounded(job->next, job->freeFunc, budget);
+        if (job->next == NULL)
+        {
+            freeArena(job->arena);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    job->root = freeNodesBounded(job->root, job->freeFunc, budget);
+    return job->root != NULL;
+}
+
+// The background reclaimer: frees the queued trees one chunk at a time, yielding the CPU between chunks.
+static void *reclaimerMain(void *unused)
+{
+    (void) unused;
+    pthread_mutex_lock(&reclaimLock);
+    while (TRUE)
+    {
+        while (reclaimHead == NULL)
+        {
+            pthread_cond_wait(&reclaimQueued, &reclaimLock);
+        }
+        ReclaimJob *job = reclaimHead;
+        reclaimHead = job->nextJob;
+        pthread_mutex_unlock(&reclaimLock);
+
+        while (reclaimChunk(job, RECLAIM_CHUNK))
+        {
+            sched_yield();
+        }
+        free(job);
+
+        pthread_mutex_lock(&reclaimLock);
+        if (--reclaimPending == 0)
+        {
+            pthread_cond_broadcast(&reclaimDone);
+        }
+    }
+    return NULL;
+}
+
+// Helper function that hands the job to the background reclaimer. Returns 0 if the reclaimer can't start.
+static int queueReclaimJob(ReclaimJob *job)
+{
+    pthread_mutex_lock(&reclaimLock);
+    if (!isReclaimerRunning)
+    {
+        pthread_t reclaimer;
+        if (pthread_create(&reclaimer, NULL, reclaimerMain, NULL) != 0)
+        {
+            pthread_mutex_unlock(&reclaimLock);
+            return FAILURE;
+        }
+        pthread_detach(reclaimer);
+        isReclaimerRunning = TRUE;
+    }
+
+    job->nextJob = NULL;
+    if (reclaimHead == NULL)
+    {
+        reclaimHead = job;
+    }
+    else
+    {
+        reclaimTail->nextJob = job;
+    }
+    reclaimTail = job;
+    reclaimPending++;
+    pthread_cond_signal(&reclaimQueued);
+    pthread_mutex_unlock(&reclaimLock);
+    return SUCCESS;
+}
+
+/**
+ * free all memory of the data structure (including the backing file of a disk tree).
+ * @param tree: the tree to free.
+ */
+void freeRBTree(RBTree *tree)
+{
+    Node *next = (tree->arena != NULL) ? firstNode(tree->root) : NULL;
+    ReclaimJob job = {tree->root, next, tree->freeFunc, tree->arena, NULL};
+    reclaimChunk(&job, SIZE_MAX);
+    freeHashIndex(tree->hashIndex);
+    closeLog(tree->log);
+    free(tree);
+}
+
+/**
+ * like freeRBTree, but returns right away and leaves freeing the nodes and items to a background thread,
+ * which frees them in small chunks and yields the CPU in between. the tree's FreeFunc is called on that
+ * thread. (if the thread can't be started, the tree is freed right away like in freeRBTree)
+ * @param tree: the tree to free.
+ */
+void freeRBTreeAsync(RBTree *tree)
+{
+    ReclaimJob *job = (ReclaimJob *) malloc(sizeof(ReclaimJob));
+    if (job == NULL)
+    {
+        freeRBTree(tree);
+        return;
+    }
+
+    job->root = tree->root;
+    job->next = (tree->arena != NULL) ? firstNode(tree->root) : NULL;
+    job->freeFunc = tree->freeFunc;
+    job->arena = tree->arena;
+    if (!queueReclaimJob(job))
+    {
+        free(job);
+        freeRBTree(tree);
+        return;
+    }
+    freeHashIndex(tree->hashIndex);
+    closeLog(tree->log);
+    free(tree);
+}
+
+/**
+ * wait until the background thread finished freeing all the trees given to freeRBTreeAsync (for example
+ * before the program exits).
+ */
+void waitForRBTreeReclaim(void)
+{
+    pthread_mutex_lock(&reclaimLock);
+    while (reclaimPending > 0)
+    {
+        pthread_cond_wait(&reclaimDone, &reclaimLock);
+    }
+    pthread_mutex_unlock(&reclaimLock);
+}
+
+/*
+ * Helper function that reads the next record of the file, with its item going to the buffer of the log.
+ * remaining is the number of bytes left in the file, and goes down by the size of the record. Returns the
+ * kind of the record and sets size to the size of its item. Returns 0 if the file ended or the record is torn
+ * or corrupt (a record that runs past the end of the file is torn, whatever its size says), and RECORD_ERROR
+ * if there is no memory for a whole record.
+ */
+static int readRecord(FILE *file, RBTreeLog *log, off_t *remaining, size_t *size)
+{
+    unsigned char header[RECORD_HEADER];
+    uint32_t recordSize, checksum;
+    if (*remaining < RECORD_HEADER || fread(header, 1, RECORD_HEADER, file) != RECORD_HEADER)
+    {
+        return 0;
+    }
+    memcpy(&recordSize, header, sizeof(uint32_t));
+    if ((off_t) recordSize + RECORD_CHECKSUM > *remaining - RECORD_HEADER)
+    {
+        return 0;
+    }
+
+    log->length = 0;
+    if (!reserveLogBuffer(log, (size_t) recordSize + RECORD_CHECKSUM))
+    {
+        return RECORD_ERROR;
+    }
+    if (fread(log->buffer, 1, (size_t) recordSize + RECORD_CHECKSUM, file) != (size_t) recordSize + RECORD_CHECKSUM)
+    {
+        return 0;
+    }
+    memcpy(&checksum, log->buffer + recordSize, sizeof(uint32_t));
+    if (checksum != recordChecksum(header[sizeof(uint32_t)], log->buffer, recordSize))
+    {
+        return 0;
+    }
+    *remaining -= RECORD_HEADER + (off_t) recordSize + RECORD_CHECKSUM;
+    *size = recordSize;
+    return header[sizeof(uint32_t)];
+}
+
+/*
+ * Helper recursive function that builds the subtree of the sorted items in [first, last) under the given
+ * parent, rooted at their middle item. All the levels above redDepth are full, so coloring the nodes of that
+ * level red and the rest black gives every path the same number of black nodes. The items that got a node
+ * are set to NULL. Returns 0 if a node couldn't be made.
+ */
+static int buildSubtree(RBTree *tree, void **items, int first, int last, Node *parent, int position, int depth,
+                        int redDepth)
+{
+    if (first >= last)
+    {
+        return SUCCESS;
+    }
+
+    int middle = first + (last - first) / 2;
+    Node *node = createNode(tree, items[middle], keyOf(tree, items[middle]), parent, position);
+    if (node == NULL)
+    {
+        return FAILURE;
+    }
+    if (parent == NULL)
+    {
+        tree->root = node;
+    }
+    node->color = (depth == redDepth) ? RED : BLACK;
+    items[middle] = NULL;
+    tree->size++;
+
+    return buildSubtree(tree, items, first, middle, node, -1, depth + 1, redDepth) &&
+           buildSubtree(tree, items, middle + 1, last, node, 1, depth + 1, redDepth);
+}
+
+/*
+ * Helper function that builds the empty tree from count sorted items in linear time, instead of adding them
+ * one by one in O(n log n). The items that weren't put in the tree (on failure) are left in items.
+ */
+static int buildFromSorted(RBTree *tree, void **items, int count)
+{
+    // The number of full levels, which is floor(log2(count + 1)).
+    int redDepth = 0;
+    while (((size_t) 2 << redDepth) <= (size_t) count + 1)
+    {
+        redDepth++;
     }
-    return containsHelper(tree, data, tree->root);
+
+    int result = buildSubtree(tree, items, 0, count, NULL, 0, 0, redDepth);
+    if (tree->root != NULL)
+    {
+        tree->min = tree->max = tree->root;
+        while (tree->min->left != NULL)
+        {
+            tree->min = tree->min->left;
+        }
+        while (tree->max->right != NULL)
+        {
+            tree->max = tree->max->right;
+        }
+    }
+    return result;
 }
 
-// Helper recursive function for the forEach function.
-static int forEachHelper(forEachFunc func, void *args, Node *current)
+/*
+ * Helper function that builds the empty tree from the checkpoint of the log and sets the generation of the
+ * log to the one of the checkpoint (0 if there is no checkpoint yet). Fails if the checkpoint is torn, out
+ * of order or can't be read.
+ */
+static int loadCheckpoint(RBTree *tree, RBTreeLog *log)
 {
-    if (current == NULL)
+    FILE *file = fopen(log->checkpointPath, "rb");
+    if (file == NULL)
     {
-        return TRUE;
+        log->generation = 0;
+        return errno == ENOENT;
     }
-    return forEachHelper(func, args, current->left) && func(current->data, args) &&
-           forEachHelper(func, args, current->right);
+
+    uint32_t magic = 0;
+    uint64_t count = 0;
+    unsigned char header[sizeof(uint32_t) + 2 * sizeof(uint64_t)];
+    struct stat status;
+    if (fstat(fileno(file), &status) == 0 && fread(header, 1, sizeof(header), file) == sizeof(header))
+    {
+        memcpy(&magic, header, sizeof(uint32_t));
+        memcpy(&log->generation, header + sizeof(uint32_t), sizeof(uint64_t));
+        memcpy(&count, header + sizeof(uint32_t) + sizeof(uint64_t), sizeof(uint64_t));
+    }
+    void **items = (magic == CHECKPOINT_MAGIC && count <= INT_MAX) ?
+                   (void **) malloc(sizeof(void *) * (count + 1)) : NULL;
+    if (items == NULL)
+    {
+        fclose(file);
+        return FAILURE;
+    }
+
+    int isValid = TRUE;
+    size_t loaded = 0, size;
+    off_t remaining = status.st_size - (off_t) sizeof(header);
+    while (isValid && loaded < count)
+    {
+        void *item = (readRecord(file, log, &remaining, &size) == RECORD_INSERT) ?
+                     log->deserialize(log->buffer, size) : NULL;
+        if (item == NULL)
+        {
+            isValid = FALSE;
+        }
+        else
+        {
+            items[loaded++] = item;
+            isValid = (loaded == 1 || tree->compFunc(items[loaded - 2], item) < 0);
+        }
+    }
+    fclose(file);
+
+    isValid = isValid && buildFromSorted(tree, items, (int) count);
+    for (size_t i = 0; i < loaded; i++)
+    {
+        if (items[i] != NULL)
+        {
+            tree->freeFunc(items[i]);
+        }
+    }
+    free(items);
+    return isValid;
+}
+
+/*
+ * Helper function that replays the changes in the log over the tree loaded from the checkpoint, if the log
+ * belongs to the generation of the checkpoint. Only a torn or corrupt record at the end of the log is
+ * dropped: the log is cut right after its last whole record and opened for the new records to follow it.
+ * When the log is missing or belongs to an older checkpoint, the fd of the log is left at -1 so the log is
+ * started over. Fails if a whole record can't be read, is of an unknown kind or its item can't be
+ * deserialized, or if the log can't be cut, without touching the log.
+ */
+static int replayLog(RBTree *tree, RBTreeLog *log)
+{
+    FILE *file = fopen(log->logPath, "rb");
+    if (file == NULL)
+    {
+        return errno == ENOENT;
+    }
+
+    uint32_t magic = 0;
+    uint64_t generation = 0;
+    unsigned char header[sizeof(uint32_t) + sizeof(uint64_t)];
+    struct stat status;
+    if (fstat(fileno(file), &status) != 0)
+    {
+        fclose(file);
+        return FAILURE;
+    }
+    if (fread(header, 1, sizeof(header), file) == sizeof(header))
+    {
+        memcpy(&magic, header, sizeof(uint32_t));
+        memcpy(&generation, header + sizeof(uint32_t), sizeof(uint64_t));
+    }
+    if (magic != LOG_MAGIC || generation != log->generation)
+    {
+        fclose(file);
+        return SUCCESS;
+    }
+
+    // The log is cut where the records that were read end.
+    off_t remaining = status.st_size - (off_t) sizeof(header);
+    int kind;
+    size_t size;
+    while ((kind = readRecord(file, log, &remaining, &size)) == RECORD_INSERT || kind == RECORD_REMOVE)
+    {
+        void *item = log->deserialize(log->buffer, size);
+        if (item == NULL)
+        {
+            fclose(file);
+            return FAILURE;
+        }
+        if (kind == RECORD_REMOVE)
+        {
+            removeFromRBTree(tree, item);
+            tree->freeFunc(item);
+        }
+        else if (!addToRBTree(tree, item))
+        {
+            tree->freeFunc(item);
+        }
+    }
+    fclose(file);
+    off_t end = status.st_size - remaining;
+    if (kind != 0 || truncate(log->logPath, end) != 0)
+    {
+        return FAILURE;
+    }
+
+    log->length = 0;
+    log->logBytes = (size_t) end;
+    log->fd = open(log->logPath, O_WRONLY | O_APPEND);
+    return log->fd >= 0;
+}
+
+// Helper function that returns a new string of the given file name in the given directory (needs to be freed).
+static char *pathInDirectory(const char *directory, const char *name)
+{
+    size_t length = strlen(directory) + strlen(name) + 2;
+    char *path = (char *) malloc(length);
+    if (path != NULL)
+    {
+        snprintf(path, length, "%s/%s", directory, name);
+    }
+    return path;
 }
 
 /**
- * Activate a function on each item of the tree. the order is an ascending order. if one of the activations of the
+ * opens a tree whose changes are kept in the given directory, recovering its items from the last run. every
+ * insertion and removal is appended to a log, and the log is synced to disk once per groupSize changes (or
+ * in syncRBTreeLog and freeRBTree). when the log grows past checkpointBytes, all the items are written in
+ * order to a checkpoint and the log starts over, so recovery reads one sorted file, builds the tree from it
+ * in linear time and replays only the changes since. a torn or corrupt record at the end of the log (left
+ * by a crash) is dropped, but a whole record that can't be read back fails the open.
+ * @param serialize: writes an item to the files.
+ * @param deserialize: reads an item back.
+ * @param directory: an existing directory for the checkpoint and log files.
+ * @param groupSize: the number of changes per sync (1 to sync on every change). changes that weren't
+ * synced may be lost in a crash.
+ * @param checkpointBytes: the size of the log that triggers a checkpoint (0 to checkpoint only in
+ * checkpointRBTree). the checkpoint is not free: it runs inside the insertion or removal that completes the
+ * group crossing the limit, which writes and syncs all the items of the tree (O(n)) before returning. to keep
+ * that stall off latency sensitive changes, pass 0 and call checkpointRBTree when it suits you.
+ * @return: the tree, or NULL on failure (including when the files are corrupt).
+ */
+RBTree *openLoggedRBTree(CompareFunc compFunc, FreeFunc freeFunc, SerializeFunc serialize,
+                         DeserializeFunc deserialize, const char *directory, int groupSize, size_t checkpointBytes)
+{
+    if (serialize == NULL || deserialize == NULL || directory == NULL || groupSize < 1)
+    {
+        return NULL;
+    }
+
+    RBTree *tree = newRBTree(compFunc, freeFunc);
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+    RBTreeLog *log = (RBTreeLog *) calloc(1, sizeof(RBTreeLog));
+    if (log == NULL)
+    {
+        free(tree);
+        return NULL;
+    }
+
+    log->serialize = serialize;
+    log->deserialize = deserialize;
+    log->fd = -1;
+    log->groupSize = groupSize;
+    log->checkpointBytes = checkpointBytes;
+    log->capacity = LOG_WRITE_CHUNK;
+    log->buffer = (unsigned char *) malloc(log->capacity);
+    log->directory = strdup(directory);
+    log->logPath = pathInDirectory(directory, "log");
+    log->checkpointPath = pathInDirectory(directory, "checkpoint");
+    log->tempPath = pathInDirectory(directory, "checkpoint.tmp");
+    if (log->buffer == NULL || log->directory == NULL || log->logPath == NULL || log->checkpointPath == NULL ||
+        log->tempPath == NULL || !loadCheckpoint(tree, log))
+    {
+        closeLog(log);
+        freeRBTree(tree);
+        return NULL;
+    }
+
+    if (!replayLog(tree, log) || (log->fd < 0 && !startLog(log)))
+    {
+        closeLog(log);
+        freeRBTree(tree);
+        return NULL;
+    }
+    tree->log = log;
+    return tree;
+}
+
+/**
+ * sync the changes of a logged tree that are waiting for their group to fill.
+ * @param tree: the logged tree.
+ * @return: 0 on failure (including an earlier failure to write the log), other on success.
+ */
+int syncRBTreeLog(RBTree *tree)
+{
+    if (tree == NULL || tree->log == NULL || tree->log->failed)
+    {
+        return FAILURE;
+    }
+    if (!commitLog(tree->log))
+    {
+        tree->log->failed = TRUE;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * write all the items of a logged tree to a new checkpoint and start a new log, syncing both (O(n)). (this
+ * also recovers a log that failed to write)
+ * @param tree: the logged tree.
+ * @return: 0 on failure, other on success.
+ */
+int checkpointRBTree(RBTree *tree)
+{
+    if (tree == NULL || tree->log == NULL)
+    {
+        return FAILURE;
+    }
+    return writeCheckpoint(tree);
+}
+
+// Helper forEach function that appends the item to the array pointed to by args.
+static int collectItem(const void *object, void *args)
+{
+    void ***cursor = (void ***) args;
+    *((*cursor)++) = (void *) object;
+    return TRUE;
+}
+
+// Helper recursive function that places the sorted items in Eytzinger order. Returns the next sorted index.
+static int fillEytzinger(FrozenRBTree *frozen, void **sorted, int index, size_t slot)
+{
+    if (slot <= (size_t) frozen->size)
+    {
+        index = fillEytzinger(frozen, sorted, index, 2 * slot);
+        frozen->data[slot] = sorted[index++];
+        index = fillEytzinger(frozen, sorted, index, 2 * slot + 1);
+    }
+    return index;
+}
+
+// Helper function that copies the inline keys of all the slots of the given frozen tree. (Assumes valid input)
+static int fillFrozenKeys(FrozenRBTree *frozen)
+{
+    size_t count = (size_t) frozen->size + 1;
+    if (frozen->keyType == FROZEN_KEY_INT)
+    {
+        int *keys = (int *) malloc(sizeof(int) * count);
+        if (keys == NULL)
+        {
+            return FAILURE;
+        }
+        for (size_t slot = 1; slot < count; slot++)
+        {
+            keys[slot] = *(const int *) ((const char *) frozen->data[slot] + frozen->keyOffset);
+        }
+        frozen->keys = keys;
+    }
+    else if (frozen->keyType == FROZEN_KEY_DOUBLE)
+    {
+        double *keys = (double *) malloc(sizeof(double) * count);
+        if (keys == NULL)
+        {
+            return FAILURE;
+        }
+        for (size_t slot = 1; slot < count; slot++)
+        {
+            keys[slot] = *(const double *) ((const char *) frozen->data[slot] + frozen->keyOffset);
+        }
+        frozen->keys = keys;
+    }
+    else if (frozen->keyType == FROZEN_KEY_NORMALIZED)
+    {
+        uint64_t *keys = (uint64_t *) malloc(sizeof(uint64_t) * count);
+        if (keys == NULL)
+        {
+            return FAILURE;
+        }
+        for (size_t slot = 1; slot < count; slot++)
+        {
+            keys[slot] = frozen->keyFunc(frozen->data[slot]);
+        }
+        frozen->keys = keys;
+    }
+    return SUCCESS;
+}
+
+/**
+ * like freezeRBTree, but also stores each item's key inline so lookups don't call compFunc or dereference
+ * the data. the key is the int or double found keyOffset bytes into each item, and must be what compFunc
+ * orders the items by.
+ * @param tree: the tree to freeze.
+ * @param keyType: FROZEN_KEY_INT or FROZEN_KEY_DOUBLE (FROZEN_KEY_NONE behaves like freezeRBTree, and
+ * FROZEN_KEY_NORMALIZED needs a tree with a KeyExtractFunc).
+ * @param keyOffset: offset of the key inside each item (0 if the items are plain int or double).
+ * @return: the frozen tree, or NULL on failure.
+ */
+FrozenRBTree *freezeRBTreeWithKeys(RBTree *tree, FrozenKeyType keyType, size_t keyOffset)
+{
+    if (tree == NULL || (int) keyType < FROZEN_KEY_NONE || (int) keyType > FROZEN_KEY_NORMALIZED ||
+        (keyType == FROZEN_KEY_NORMALIZED && tree->keyFunc == NULL))
+    {
+        return NULL;
+    }
+
+    FrozenRBTree *frozen = (FrozenRBTree *) malloc(sizeof(FrozenRBTree));
+    void **sorted = (void **) malloc(sizeof(void *) * (tree->size + 1));
+    if (frozen == NULL || sorted == NULL)
+    {
+        free(frozen);
+        free(sorted);
+        return NULL;
+    }
+
+    frozen->keys = NULL;
+    frozen->keyOffset = keyOffset;
+    frozen->keyType = (keyType == FROZEN_KEY_NONE && tree->keyFunc != NULL) ? FROZEN_KEY_NORMALIZED : keyType;
+    frozen->compFunc = tree->compFunc;
+    frozen->keyFunc = tree->keyFunc;
+    frozen->size = tree->size;
+    frozen->data = (void **) malloc(sizeof(void *) * (tree->size + 1));
+    if (frozen->data == NULL)
+    {
+        free(sorted);
+        free(frozen);
+        return NULL;
+    }
+
+    void **cursor = sorted;
+    forEachRBTree(tree, collectItem, &cursor);
+    frozen->data[0] = NULL;
+    fillEytzinger(frozen, sorted, 0, 1);
+    free(sorted);
+
+    if (!fillFrozenKeys(frozen))
+    {
+        free(frozen->data);
+        free(frozen);
+        return NULL;
+    }
+    return frozen;
+}
+
+/**
+ * freeze the tree into an immutable search array. the data items are still owned by the tree, so the
+ * frozen tree must be freed before the tree it was made from. if the tree has a KeyExtractFunc, the
+ * normalized keys are stored inline and compFunc is only called on equal keys. otherwise every step of a
+ * lookup calls compFunc on an item that is usually not in the cache, so the items a few levels down are
+ * prefetched, but a lookup is only about twice as fast as containsRBTree. (freezeRBTreeWithKeys and
+ * setKeyExtractRBTree make it several times faster)
+ * @param tree: the tree to freeze.
+ * @return: the frozen tree, or NULL on failure.
+ */
+FrozenRBTree *freezeRBTree(RBTree *tree)
+{
+    return freezeRBTreeWithKeys(tree, FROZEN_KEY_NONE, 0);
+}
+
+/*
+ * Helper function that returns the slot of the first item that isn't smaller than data, or 0 if there is
+ * none. The descent has no branches on the comparisons, so its cost doesn't depend on the keys, and the
+ * slots a few levels down are prefetched while the current level is compared. (Assumes valid input)
+ */
+static size_t frozenLowerBound(const FrozenRBTree *frozen, const void *data)
+{
+    size_t slot = 1, size = (size_t) frozen->size;
+    if (frozen->keyType == FROZEN_KEY_INT)
+    {
+        const int *keys = (const int *) frozen->keys;
+        int key = *(const int *) ((const char *) data + frozen->keyOffset);
+        while (slot <= size)
+        {
+            __builtin_prefetch(keys + FROZEN_PREFETCH_SPAN * slot);
+            slot = 2 * slot + (keys[slot] < key);
+        }
+    }
+    else if (frozen->keyType == FROZEN_KEY_DOUBLE)
+    {
+        const double *keys = (const double *) frozen->keys;
+        double key = *(const double *) ((const char *) data + frozen->keyOffset);
+        while (slot <= size)
+        {
+            __builtin_prefetch(keys + FROZEN_PREFETCH_SPAN * slot);
+            slot = 2 * slot + (keys[slot] < key);
+        }
+    }
+    else if (frozen->keyType == FROZEN_KEY_NORMALIZED)
+    {
+        const uint64_t *keys = (const uint64_t *) frozen->keys;
+        uint64_t key = frozen->keyFunc(data);
+        while (slot <= size)
+        {
+            __builtin_prefetch(keys + FROZEN_PREFETCH_SPAN * slot);
+            slot = 2 * slot + (keys[slot] < key ||
+                               (keys[slot] == key && frozen->compFunc(data, frozen->data[slot]) > 0));
+        }
+    }
+    else
+    {
+        // Besides the slots, the items two levels down are prefetched, since compFunc reads them.
+        void *const *items = frozen->data;
+        while (slot <= size)
+        {
+            __builtin_prefetch(items + FROZEN_PREFETCH_SPAN * slot);
+            if (4 * slot + 3 <= size)
+            {
+                __builtin_prefetch(items[4 * slot]);
+                __builtin_prefetch(items[4 * slot + 1]);
+                __builtin_prefetch(items[4 * slot + 2]);
+                __builtin_prefetch(items[4 * slot + 3]);
+            }
+            slot = 2 * slot + (frozen->compFunc(data, items[slot]) > 0);
+        }
+    }
+
+    // The path went right on every slot smaller than data, so dropping the trailing right turns and the
+    // last left turn leaves the slot where it went left for the last time.
+    return slot >> __builtin_ffsll((long long) ~slot);
+}
+
+/**
+ * find the item of the frozen tree that is equal to data.
+ * @param frozen: the frozen tree to search.
+ * @param data: item to look for.
+ * @return: the item in the frozen tree, or NULL if it's not there.
+ */
+void *findFrozenRBTree(const FrozenRBTree *frozen, const void *data)
+{
+    if (frozen == NULL || data == NULL)
+    {
+        return NULL;
+    }
+
+    size_t slot = frozenLowerBound(frozen, data);
+    if (slot == 0)
+    {
+        return NULL;
+    }
+
+    int isEqual;
+    if (frozen->keyType == FROZEN_KEY_INT)
+    {
+        isEqual = ((const int *) frozen->keys)[slot] == *(const int *) ((const char *) data + frozen->keyOffset);
+    }
+    else if (frozen->keyType == FROZEN_KEY_DOUBLE)
+    {
+        isEqual = ((const double *) frozen->keys)[slot] ==
+                  *(const double *) ((const char *) data + frozen->keyOffset);
+    }
+    else
+    {
+        isEqual = (frozen->compFunc(data, frozen->data[slot]) == 0);
+    }
+    return isEqual ? frozen->data[slot] : NULL;
+}
+
+/**
+ * check whether the frozen tree contains this item.
+ * @param frozen: the frozen tree to search.
+ * @param data: item to check.
+ * @return: 0 if the item is not in the frozen tree, other if it is.
+ */
+int containsFrozenRBTree(const FrozenRBTree *frozen, const void *data)
+{
+    return findFrozenRBTree(frozen, data) != NULL;
+}
+
+/**
+ * Activate a function on each item of the frozen tree in ascending order. if one of the activations of the
  * function returns 0, the process stops.
- * @param tree: the tree with all the items.
+ * @param frozen: the frozen tree with all the items.
  * @param func: the function to activate on all items.
  * @param args: more optional arguments to the function (may be null if the given function support it).
  * @return: 0 on failure, other on success.
  */
-int forEachRBTree(RBTree *tree, forEachFunc func, void *args)
+int forEachFrozenRBTree(const FrozenRBTree *frozen, forEachFunc func, void *args)
 {
-    if (tree == NULL || func == NULL)
+    if (frozen == NULL || func == NULL)
     {
         return FAILURE;
     }
-    return forEachHelper(func, args, tree->root);
-}
 
-// Helper recursive function for the freeTree function.
-static void freeTreeHelper(Node *current, FreeFunc freeFunc)
-{
-    if (current != NULL)
+    size_t size = (size_t) frozen->size, slot = 1;
+    if (size == 0)
     {
-        freeTreeHelper(current->left, freeFunc);
-        freeTreeHelper(current->right, freeFunc);
-        freeFunc(current->data);
-        free(current);
+        return SUCCESS;
+    }
+    while (2 * slot <= size)
+    {
+        slot *= 2;
+    }
+
+    while (slot != 0)
+    {
+        if (!func(frozen->data[slot], args))
+        {
+            return FAILURE;
+        }
+
+        if (2 * slot + 1 <= size)
+        {
+            slot = 2 * slot + 1;
+            while (2 * slot <= size)
+            {
+                slot *= 2;
+            }
+        }
+        else
+        {
+            // Climb past the right turns, then past the left turn whose parent comes next.
+            slot >>= __builtin_ffsll((long long) ~slot);
+        }
     }
+    return SUCCESS;
 }
 
 /**
- * free all memory of the data structure.
- * @param tree: the tree to free.
+ * free the memory of the frozen tree (but not the items, which belong to the original tree).
+ * @param frozen: the frozen tree to free.
  */
-void freeRBTree(RBTree *tree)
+void freeFrozenRBTree(FrozenRBTree *frozen)
 {
-    freeTreeHelper(tree->root, tree->freeFunc);
-    free(tree);
+    if (frozen != NULL)
+    {
+        free(frozen->data);
+        free(frozen->keys);
+        free(frozen);
+    }
 }
 
 
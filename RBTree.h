@@ -10,6 +10,9 @@
 #ifndef RBTREE_RBTREE_H
 #define RBTREE_RBTREE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // a color of a Node.
 typedef enum Color
 {
@@ -37,6 +40,39 @@ typedef int (*forEachFunc)(const void *object, void *args);
  */
 typedef void (*FreeFunc)(void *data);
 
+/**
+ * a function that maps an item to a number that keeps the order of the items: if a < b then
+ * key(a) <= key(b). items with different keys are ordered by their keys alone.
+ * @data: a pointer to an item of the tree.
+ * @return: the normalized key of the item.
+ */
+typedef uint64_t (*KeyExtractFunc)(const void *data);
+
+/**
+ * a function that hashes the tree items. equal items (by compFunc) must have equal hashes.
+ * @data: a pointer to an item of the tree.
+ * @return: the hash of the item.
+ */
+typedef size_t (*HashFunc)(const void *data);
+
+/**
+ * a function that writes an item to a buffer, for trees with a write-ahead log.
+ * @data: a pointer to an item of the tree.
+ * @buffer: where to write the item.
+ * @capacity: the size of buffer in bytes.
+ * @return: the size of the written item in bytes. if it's larger than capacity, nothing needs to be written
+ * and the function is called again with a large enough buffer.
+ */
+typedef size_t (*SerializeFunc)(const void *data, void *buffer, size_t capacity);
+
+/**
+ * a function that rebuilds an item written by a SerializeFunc.
+ * @buffer: the written item.
+ * @size: its size in bytes.
+ * @return: a new item (freed with the tree's FreeFunc), or NULL on failure.
+ */
+typedef void *(*DeserializeFunc)(const void *buffer, size_t size);
+
 /*
  * a node of the tree.
  */
@@ -45,9 +81,28 @@ typedef struct Node
 	struct Node *parent, *left, *right;
 	Color color;
 	void *data;
+	uint64_t key; // the normalized key of data (only used if the tree has a KeyExtractFunc).
 
 } Node;
 
+// the file-backed memory that holds the nodes of a disk tree (see newDiskRBTree).
+typedef struct NodeArena NodeArena;
+
+// a hash table of the items of a tree (see enableHashIndexRBTree).
+typedef struct HashIndex HashIndex;
+
+// the write-ahead log of a tree (see openLoggedRBTree).
+typedef struct RBTreeLog RBTreeLog;
+
+/**
+ * how much memory a tree takes, to decide whether a hash index is worth it.
+ */
+typedef struct RBTreeMemory
+{
+	size_t treeBytes, hashIndexBytes;
+	double hashLoadFactor;
+} RBTreeMemory;
+
 /**
  * represents the tree
  */
@@ -57,6 +112,13 @@ typedef struct RBTree
 	CompareFunc compFunc;
 	FreeFunc freeFunc;
 	int size;
+	Node *finger; // the last added node.
+	int useFinger;
+	KeyExtractFunc keyFunc; // NULL unless set with setKeyExtractRBTree.
+	HashIndex *hashIndex; // NULL unless made with enableHashIndexRBTree.
+	NodeArena *arena; // NULL unless the nodes live in a file (see newDiskRBTree).
+	Node *min, *max; // the first and last nodes in ascending order.
+	RBTreeLog *log; // NULL unless opened with openLoggedRBTree.
 } RBTree;
 
 /**
@@ -65,6 +127,66 @@ typedef struct RBTree
  */
 RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc); // implement it in RBTree.c
 
+/**
+ * constructs a new RBTree whose nodes live in a memory mapped file instead of the heap, for trees whose nodes
+ * don't fit in RAM. only the nodes move to the file: the items are still allocated by the caller, so the
+ * items themselves must fit in memory (this pays off for small items, or items that live in a file of
+ * their own). every time the tree doubles (and in refreshDiskRBTreeCache), the nodes are laid out again so
+ * every page holds the top levels of subtrees, and a search touches about one page per log2 of the number
+ * of nodes on a page (instead of one page per level). nodes added in between go on the page of their parent
+ * when it has room. the layout moves nodes, so a Node pointer of a disk tree (like from lowerBoundRBTree)
+ * is only valid until the next change.
+ * @param path: a new file for the nodes (truncated if it exists). the file is deleted right away and only
+ * lives on as long as the tree, since it holds pointers that mean nothing outside this process.
+ * @param capacity: the maximal size of the backing file in bytes. the file is sparse, so only the pages in
+ * use take disk space.
+ * @param cachedPages: the number of pages holding the top levels of the tree to keep in RAM (0 for none).
+ */
+RBTree *newDiskRBTree(CompareFunc compFunc, FreeFunc freeFunc, const char *path, size_t capacity, int cachedPages);
+
+/**
+ * lay out the nodes of a disk tree again and recollect the pages that are kept in RAM, after changes moved
+ * its top levels. (this also happens by itself every time the size of the tree doubles)
+ * @param tree: the disk tree.
+ */
+void refreshDiskRBTreeCache(RBTree *tree);
+
+/**
+ * opens a tree whose changes are kept in the given directory, recovering its items from the last run. every
+ * insertion and removal is appended to a log, and the log is synced to disk once per groupSize changes (or
+ * in syncRBTreeLog and freeRBTree). when the log grows past checkpointBytes, all the items are written in
+ * order to a checkpoint and the log starts over, so recovery reads one sorted file, builds the tree from it
+ * in linear time and replays only the changes since. a torn or corrupt record at the end of the log (left
+ * by a crash) is dropped, but a whole record that can't be read back fails the open.
+ * @param serialize: writes an item to the files.
+ * @param deserialize: reads an item back.
+ * @param directory: an existing directory for the checkpoint and log files.
+ * @param groupSize: the number of changes per sync (1 to sync on every change). changes that weren't
+ * synced may be lost in a crash.
+ * @param checkpointBytes: the size of the log that triggers a checkpoint (0 to checkpoint only in
+ * checkpointRBTree). the checkpoint is not free: it runs inside the insertion or removal that completes the
+ * group crossing the limit, which writes and syncs all the items of the tree (O(n)) before returning. to keep
+ * that stall off latency sensitive changes, pass 0 and call checkpointRBTree when it suits you.
+ * @return: the tree, or NULL on failure (including when the files are corrupt).
+ */
+RBTree *openLoggedRBTree(CompareFunc compFunc, FreeFunc freeFunc, SerializeFunc serialize,
+						 DeserializeFunc deserialize, const char *directory, int groupSize, size_t checkpointBytes);
+
+/**
+ * sync the changes of a logged tree that are waiting for their group to fill.
+ * @param tree: the logged tree.
+ * @return: 0 on failure (including an earlier failure to write the log), other on success.
+ */
+int syncRBTreeLog(RBTree *tree);
+
+/**
+ * write all the items of a logged tree to a new checkpoint and start a new log, syncing both (O(n)). (this
+ * also recovers a log that failed to write)
+ * @param tree: the logged tree.
+ * @return: 0 on failure, other on success.
+ */
+int checkpointRBTree(RBTree *tree);
+
 /**
  * add an item to the tree
  * @param tree: the tree to add an item to.
@@ -73,6 +195,80 @@ RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc); // implement it in R
  */
 int addToRBTree(RBTree *tree, void *data); // implement it in RBTree.c
 
+/**
+ * make the tree order its items by a normalized key before comparing them with compFunc. every node stores
+ * the key of its item, so a search compares numbers and only calls compFunc when the keys are equal.
+ * @param tree: the tree to configure (must be empty).
+ * @param keyFunc: a function that maps every item to a key that keeps their order (NULL to stop using keys).
+ * @return: 0 on failure (if the tree isn't empty), other on success.
+ */
+int setKeyExtractRBTree(RBTree *tree, KeyExtractFunc keyFunc);
+
+/**
+ * keep a hash index of the items next to the tree, so containsRBTree, the batched lookups and the check
+ * for duplicates in addToRBTree take O(1) expected time. ordered operations keep using the tree.
+ * @param tree: the tree to index.
+ * @param hashFunc: a function that hashes the items (equal items must have equal hashes).
+ * @return: 0 on failure, other on success.
+ */
+int enableHashIndexRBTree(RBTree *tree, HashFunc hashFunc);
+
+/**
+ * stop keeping a hash index next to the tree and free it.
+ * @param tree: the indexed tree.
+ */
+void disableHashIndexRBTree(RBTree *tree);
+
+/**
+ * report how much memory the tree and its hash index take.
+ * @param tree: the tree.
+ * @param memory: filled with the sizes in bytes (hashIndexBytes is 0 without a hash index) and the
+ * fraction of the hash index entries in use.
+ * @return: 0 on failure, other on success.
+ */
+int memoryRBTree(RBTree *tree, RBTreeMemory *memory);
+
+/**
+ * add an item to the tree, starting the search for its place from the given node. if the item belongs
+ * right next to the hint (for example after the last added node when adding in ascending order), it is
+ * added with at most two comparisons. otherwise it is added like in addToRBTree.
+ * @param tree: the tree to add an item to.
+ * @param hint: a node of the tree near the place of the item, for example from lowerBoundRBTree (may be NULL).
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int addWithHintRBTree(RBTree *tree, Node *hint, void *data);
+
+/**
+ * turn the last insertion finger on or off. while it is on, addToRBTree first tries to add the item next to
+ * the last added node (tree->finger), so adding items in (nearly) sorted order skips the descent.
+ * @param tree: the tree to configure.
+ * @param useFinger: 0 to turn the finger off, other to turn it on.
+ */
+void setFingerRBTree(RBTree *tree, int useFinger);
+
+/**
+ * find the node of the first item of the tree that isn't smaller than data, to use as the hint of
+ * addWithHintRBTree for items near data, or to walk the tree in order from it with nextNodeRBTree and
+ * previousNodeRBTree. a node stays valid until its own item is removed (in a disk tree, until the next change).
+ * @param tree: the tree to search.
+ * @param data: the item to look for.
+ * @return: the node (its item is node->data), or NULL if every item is smaller than data.
+ */
+Node *lowerBoundRBTree(RBTree *tree, const void *data);
+
+/**
+ * @param node: a node of a tree.
+ * @return: the node of the next item in ascending order, or NULL if node is the last one (or NULL).
+ */
+Node *nextNodeRBTree(Node *node);
+
+/**
+ * @param node: a node of a tree.
+ * @return: the node of the previous item in ascending order, or NULL if node is the first one (or NULL).
+ */
+Node *previousNodeRBTree(Node *node);
+
 /**
  * check whether the tree contains this item.
  * @param tree: the tree to add an item to.
@@ -81,7 +277,63 @@ int addToRBTree(RBTree *tree, void *data); // implement it in RBTree.c
  */
 int containsRBTree(RBTree *tree, void *data); // implement it in RBTree.c
 
+/**
+ * remove an item from the tree and free it with the tree's FreeFunc.
+ * @param tree: the tree to remove an item from.
+ * @param data: an item equal to the one to remove.
+ * @return: 0 on failure, other on success. (if the item is not in the tree - failure).
+ */
+int removeFromRBTree(RBTree *tree, void *data);
+
+/**
+ * @param tree: the tree.
+ * @return: the smallest item of the tree in O(1), or NULL if the tree is empty.
+ */
+void *minRBTree(RBTree *tree);
+
+/**
+ * @param tree: the tree.
+ * @return: the largest item of the tree in O(1), or NULL if the tree is empty.
+ */
+void *maxRBTree(RBTree *tree);
+
+/**
+ * remove the smallest item from the tree and return it (it's not freed). the next smallest item is found
+ * from the removed one, in amortized O(1).
+ * @param tree: the tree.
+ * @return: the removed item, or NULL if the tree is empty.
+ */
+void *popMinRBTree(RBTree *tree);
+
+/**
+ * remove the largest item from the tree and return it (it's not freed). the next largest item is found
+ * from the removed one, in amortized O(1).
+ * @param tree: the tree.
+ * @return: the removed item, or NULL if the tree is empty.
+ */
+void *popMaxRBTree(RBTree *tree);
+
+
+/**
+ * check whether the tree contains each of the given items. the searches are interleaved, so the memory
+ * latency of one search is hidden behind the work of the others.
+ * @param tree: the tree to search.
+ * @param keys: the items to check.
+ * @param n: the number of items to check.
+ * @param results: filled with 0 for every item that is not in the tree and with other values for the rest.
+ * @return: 0 on failure, other on success.
+ */
+int containsBatchRBTree(RBTree *tree, void *const *keys, int n, int *results);
 
+/**
+ * find the items of the tree that are equal to each of the given items (see containsBatchRBTree).
+ * @param tree: the tree to search.
+ * @param keys: the items to look for.
+ * @param n: the number of items to look for.
+ * @param results: filled with the item of the tree equal to each key, or NULL if there is none.
+ * @return: 0 on failure, other on success.
+ */
+int findBatchRBTree(RBTree *tree, void *const *keys, int n, void **results);
 
 /**
  * Activate a function on each item of the tree. the order is an ascending order. if one of the activations of the
@@ -94,10 +346,102 @@ int containsRBTree(RBTree *tree, void *data); // implement it in RBTree.c
 int forEachRBTree(RBTree *tree, forEachFunc func, void *args); // implement it in RBTree.c
 
 /**
- * free all memory of the data structure.
+ * free all memory of the data structure (including the backing file of a disk tree).
  * @param tree: the tree to free.
  */
 void freeRBTree(RBTree *tree); // implement it in RBTree.c
 
+/**
+ * like freeRBTree, but returns right away and leaves freeing the nodes and items to a background thread,
+ * which frees them in small chunks and yields the CPU in between. the tree's FreeFunc is called on that
+ * thread. (if the thread can't be started, the tree is freed right away like in freeRBTree)
+ * @param tree: the tree to free.
+ */
+void freeRBTreeAsync(RBTree *tree);
+
+/**
+ * wait until the background thread finished freeing all the trees given to freeRBTreeAsync (for example
+ * before the program exits).
+ */
+void waitForRBTreeReclaim(void);
+
+// the kind of key a frozen tree keeps inline next to its data pointers. (FROZEN_KEY_NORMALIZED holds the
+// keys of the tree's KeyExtractFunc, and is chosen by freezeRBTree itself)
+typedef enum FrozenKeyType
+{
+	FROZEN_KEY_NONE, FROZEN_KEY_INT, FROZEN_KEY_DOUBLE, FROZEN_KEY_NORMALIZED
+} FrozenKeyType;
+
+/**
+ * an immutable snapshot of a tree, stored as a contiguous array in Eytzinger (BFS) order.
+ * slot 1 is the root and the children of slot k are 2k and 2k + 1 (slot 0 is unused).
+ */
+typedef struct FrozenRBTree
+{
+	void **data;
+	void *keys;
+	size_t keyOffset;
+	FrozenKeyType keyType;
+	CompareFunc compFunc;
+	KeyExtractFunc keyFunc; // the keys of FROZEN_KEY_NORMALIZED.
+	int size;
+} FrozenRBTree;
+
+/**
+ * freeze the tree into an immutable search array. the data items are still owned by the tree, so the
+ * frozen tree must be freed before the tree it was made from. if the tree has a KeyExtractFunc, the
+ * normalized keys are stored inline and compFunc is only called on equal keys. otherwise every step of a
+ * lookup calls compFunc on an item that is usually not in the cache, so the items a few levels down are
+ * prefetched, but a lookup is only about twice as fast as containsRBTree. (freezeRBTreeWithKeys and
+ * setKeyExtractRBTree make it several times faster)
+ * @param tree: the tree to freeze.
+ * @return: the frozen tree, or NULL on failure.
+ */
+FrozenRBTree *freezeRBTree(RBTree *tree);
+
+/**
+ * like freezeRBTree, but also stores each item's key inline so lookups don't call compFunc or dereference
+ * the data. the key is the int or double found keyOffset bytes into each item, and must be what compFunc
+ * orders the items by.
+ * @param tree: the tree to freeze.
+ * @param keyType: FROZEN_KEY_INT or FROZEN_KEY_DOUBLE (FROZEN_KEY_NONE behaves like freezeRBTree, and
+ * FROZEN_KEY_NORMALIZED needs a tree with a KeyExtractFunc).
+ * @param keyOffset: offset of the key inside each item (0 if the items are plain int or double).
+ * @return: the frozen tree, or NULL on failure.
+ */
+FrozenRBTree *freezeRBTreeWithKeys(RBTree *tree, FrozenKeyType keyType, size_t keyOffset);
+
+/**
+ * find the item of the frozen tree that is equal to data.
+ * @param frozen: the frozen tree to search.
+ * @param data: item to look for.
+ * @return: the item in the frozen tree, or NULL if it's not there.
+ */
+void *findFrozenRBTree(const FrozenRBTree *frozen, const void *data);
+
+/**
+ * check whether the frozen tree contains this item.
+ * @param frozen: the frozen tree to search.
+ * @param data: item to check.
+ * @return: 0 if the item is not in the frozen tree, other if it is.
+ */
+int containsFrozenRBTree(const FrozenRBTree *frozen, const void *data);
+
+/**
+ * Activate a function on each item of the frozen tree in ascending order. if one of the activations of the
+ * function returns 0, the process stops.
+ * @param frozen: the frozen tree with all the items.
+ * @param func: the function to activate on all items.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachFrozenRBTree(const FrozenRBTree *frozen, forEachFunc func, void *args);
+
+/**
+ * free the memory of the frozen tree (but not the items, which belong to the original tree).
+ * @param frozen: the frozen tree to free.
+ */
+void freeFrozenRBTree(FrozenRBTree *frozen);
+
 
 #endif //RBTREE_RBTREE_H
\ No newline at end of file
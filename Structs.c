@@ -7,9 +7,14 @@
  * @brief This file implements example functions to use with the red-black tree library.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <float.h>
+#include <stdint.h>
 #include "RBTree.h"
 
 #ifndef TA_EX3_STRUCTS_H
@@ -24,6 +29,86 @@ typedef struct Vector
     double *vector;
 } Vector;
 
+/**
+ * A Vector stored in a single allocation: the header is padded to 32 bytes and followed by the coordinates,
+ * which are 32 byte aligned for AVX loads. Vectors taken from a VectorPool remember it, so freeInlineVector
+ * returns them there. capacity is the number of coordinates there is room for (at least len).
+ */
+typedef struct InlineVector
+{
+    struct VectorPool *pool;
+    int len, capacity;
+    char padding[32 - sizeof(struct VectorPool *) - 2 * sizeof(int)];
+    double vector[];
+} InlineVector;
+
+/**
+ * Hands out InlineVectors of one length from large chunks, and keeps the freed ones for reuse.
+ */
+typedef struct VectorPool
+{
+    int len, vectorsPerChunk;
+    size_t vectorSize;
+    InlineVector *freeVectors;
+    void *chunks;
+} VectorPool;
+
+/**
+ * Tracks the InlineVector with the largest norm seen by copyIfInlineNormIsLarger. max is a copy that is
+ * overwritten in place whenever it has room for the new maximum. Start with max == NULL.
+ */
+typedef struct InlineMaxVector
+{
+    InlineVector *max;
+    double normSquared;
+} InlineMaxVector;
+
+/**
+ * Where exported strings are written: a buffer that is filled from length on and, if fd >= 0, written to fd
+ * whenever it gets full. Otherwise a full buffer is reallocated to twice its size if isGrowable, or the
+ * export fails. (exportStringsToBuffer, exportStringsGrowable and exportStringsToFd set one up; a growable
+ * cursor may also start as {NULL, 0, 0, 1, -1}, and its buffer then needs to be freed)
+ */
+typedef struct StringCursor
+{
+    char *buffer;
+    size_t length, capacity;
+    int isGrowable, fd;
+} StringCursor;
+
+/**
+ * A k-d tree over Vectors of the same length, for nearest neighbour and radius queries with the L2
+ * distance. The vectors are kept in one array, with the median of every range at its middle and the ranges
+ * on each side of it as its subtrees (split by coordinate depth % dim).
+ */
+typedef struct KDTree
+{
+    Vector **vectors;
+    double *normSquared, *maxNormSquared;
+    int size, dim, ownsVectors;
+} KDTree;
+
+/**
+ * The k closest vectors found so far by a nearest neighbour search, as a max heap by distance.
+ */
+typedef struct NeighbourHeap
+{
+    Vector **vectors;
+    double *distances;
+    int size, capacity;
+} NeighbourHeap;
+
+
+// Size of the buffer used to export strings to a file descriptor.
+#define EXPORT_BUFFER_SIZE (1 << 16)
+// Starting size of the buffer of exportStringsGrowable.
+#define EXPORT_GROWABLE_START 256
+
+// Alignment of InlineVectors and their coordinates, the size their allocations are rounded up to and the
+// space before the first vector of a pool chunk.
+#define VECTOR_ALIGNMENT 32
+// Number of vectors in each chunk of a VectorPool.
+#define VECTORS_PER_CHUNK 64
 
 /**
  * CompFunc for strings (assumes strings end with "\0")
@@ -37,6 +122,24 @@ int stringCompare(const void *a, const void *b)
     return strcmp((char *) a, (char *) b);
 }
 
+/**
+ * KeyExtractFunc for strings that keeps the order of stringCompare: the first 8 characters as a big endian
+ * number (shorter strings are padded with zeros).
+ * @param s - char* pointer
+ * @return the normalized key of s
+ */
+uint64_t stringKey(const void *s)
+{
+    const unsigned char *str = (const unsigned char *) s;
+    uint64_t key = 0;
+    int i = 0;
+    for (; i < 8 && str[i] != '\0'; i++)
+    {
+        key = (key << 8) | str[i];
+    }
+    return (i == 0) ? 0 : key << (8 * (8 - i));
+}
+
 /**
  * ForEach function that concatenates the given word to pConcatenated. pConcatenated is already allocated with
  * enough space.
@@ -56,6 +159,218 @@ int concatenate(const void *word, void *pConcatenated)
     return 1;
 }
 
+// Helper function that writes the whole given range to fd, retrying partial writes.
+static int writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            return 0;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+    return 1;
+}
+
+// Helper function that makes room for size more characters (and a "\0") at the cursor. Returns 0 on failure.
+static int reserveAtCursor(StringCursor *cursor, size_t size)
+{
+    if (cursor->length + size < cursor->capacity)
+    {
+        return 1;
+    }
+
+    if (cursor->fd >= 0)
+    {
+        int success = writeAll(cursor->fd, cursor->buffer, cursor->length);
+        cursor->length = 0;
+        return success;
+    }
+
+    if (!cursor->isGrowable)
+    {
+        return 0;
+    }
+
+    size_t capacity = (cursor->capacity > 0) ? cursor->capacity : 1;
+    while (cursor->length + size >= capacity)
+    {
+        capacity *= 2;
+    }
+    char *buffer = (char *) realloc(cursor->buffer, capacity);
+    if (buffer == NULL)
+    {
+        return 0;
+    }
+    cursor->buffer = buffer;
+    cursor->capacity = capacity;
+    return 1;
+}
+
+/**
+ * ForEach function like concatenate, that writes the given word and "\n" at the cursor instead of searching
+ * for the end of the string, so exporting a tree takes linear time.
+ * @param word - char* to write
+ * @param pCursor - StringCursor*
+ * @return 0 on failure, other on success
+ */
+int concatenateAt(const void *word, void *pCursor)
+{
+    if (word == NULL || pCursor == NULL)
+    {
+        return 0;
+    }
+
+    StringCursor *cursor = (StringCursor *) pCursor;
+    size_t len = strlen((char *) word);
+    if (!reserveAtCursor(cursor, len + 1))
+    {
+        return 0;
+    }
+
+    // A word longer than the whole buffer of a file export goes straight to the file.
+    if (cursor->fd >= 0 && len + 1 >= cursor->capacity)
+    {
+        return writeAll(cursor->fd, (char *) word, len) && writeAll(cursor->fd, "\n", 1);
+    }
+
+    memcpy(cursor->buffer + cursor->length, word, len);
+    cursor->length += len;
+    cursor->buffer[cursor->length++] = '\n';
+    if (cursor->fd < 0)
+    {
+        cursor->buffer[cursor->length] = '\0';
+    }
+    return 1;
+}
+
+// ForEach function that adds the length the word takes in an export to the size_t pointed to by pLength.
+static int addExportedLength(const void *word, void *pLength)
+{
+    *(size_t *) pLength += strlen((char *) word) + 1;
+    return 1;
+}
+
+/**
+ * @param tree a pointer to a tree of strings
+ * @return the exact number of characters exporting the tree writes (each string and "\n", without the
+ * final "\0").
+ */
+size_t exportedStringsLength(RBTree *tree)
+{
+    size_t length = 0;
+    forEachRBTree(tree, addExportedLength, &length);
+    return length;
+}
+
+/**
+ * Writes the strings of the tree in ascending order, each followed by "\n", to the given buffer.
+ * @param tree a pointer to a tree of strings
+ * @param buffer where to write, it ends with "\0"
+ * @param capacity the size of buffer
+ * @return 1 on success, 0 on failure (if the buffer is too small).
+ */
+int exportStringsToBuffer(RBTree *tree, char *buffer, size_t capacity)
+{
+    if (tree == NULL || buffer == NULL || capacity == 0)
+    {
+        return 0;
+    }
+
+    StringCursor cursor = {buffer, 0, capacity, 0, -1};
+    buffer[0] = '\0';
+    return forEachRBTree(tree, concatenateAt, &cursor);
+}
+
+/**
+ * @param tree a pointer to a tree of strings
+ * @return a new string (needs to be freed) of exactly the right size with the strings of the tree in
+ * ascending order, each followed by "\n". NULL on failure.
+ */
+char *exportStrings(RBTree *tree)
+{
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    size_t capacity = exportedStringsLength(tree) + 1;
+    char *buffer = (char *) malloc(capacity);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    if (!exportStringsToBuffer(tree, buffer, capacity))
+    {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+/**
+ * Writes the strings of the tree in ascending order, each followed by "\n", to a new buffer that grows as
+ * needed, so the tree is walked only once (exportStrings measures it first).
+ * @param tree a pointer to a tree of strings
+ * @param pLength if not NULL, set to the length of the result (without the final "\0")
+ * @return a new string (needs to be freed), or NULL on failure.
+ */
+char *exportStringsGrowable(RBTree *tree, size_t *pLength)
+{
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    StringCursor cursor = {(char *) malloc(EXPORT_GROWABLE_START), 0, EXPORT_GROWABLE_START, 1, -1};
+    if (cursor.buffer == NULL)
+    {
+        return NULL;
+    }
+    cursor.buffer[0] = '\0';
+    if (!forEachRBTree(tree, concatenateAt, &cursor))
+    {
+        free(cursor.buffer);
+        return NULL;
+    }
+
+    if (pLength != NULL)
+    {
+        *pLength = cursor.length;
+    }
+    return cursor.buffer;
+}
+
+/**
+ * Writes the strings of the tree in ascending order, each followed by "\n", to a file descriptor, with
+ * large buffered writes.
+ * @param tree a pointer to a tree of strings
+ * @param fd an open file descriptor
+ * @return 1 on success, 0 on failure.
+ */
+int exportStringsToFd(RBTree *tree, int fd)
+{
+    if (tree == NULL || fd < 0)
+    {
+        return 0;
+    }
+
+    char *buffer = (char *) malloc(EXPORT_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        return 0;
+    }
+
+    StringCursor cursor = {buffer, 0, EXPORT_BUFFER_SIZE, 0, fd};
+    int success = forEachRBTree(tree, concatenateAt, &cursor) && writeAll(fd, buffer, cursor.length);
+    free(buffer);
+    return success;
+}
+
 /**
  * FreeFunc for strings
  */
@@ -67,19 +382,9 @@ void freeString(void *s)
     }
 }
 
-/**
- * CompFunc for Vectors, compares element by element, the vector that has the first larger
- * element is considered larger. If vectors are of different lengths and identify for the length
- * of the shorter vector, the shorter vector is considered smaller.
- * @param a - first vector
- * @param b - second vector
- * @return equal to 0 iff a == b. lower than 0 if a < b. Greater than 0 iff b < a.
- */
-int vectorCompare1By1(const void *a, const void *b)
+// Helper function that compares two arrays element by element, like vectorCompare1By1.
+static int compareArrays(const double *arr1, int len1, const double *arr2, int len2)
 {
-    Vector *vector1 = (Vector *) a, *vector2 = (Vector *) b;
-    double *arr1 = vector1->vector, *arr2 = vector2->vector;
-    int len1 = vector1->len, len2 = vector2->len;
     int minLen = (len1 < len2) ? len1 : len2;
 
     for (int i = 0; i < minLen; i++)
@@ -97,6 +402,20 @@ int vectorCompare1By1(const void *a, const void *b)
     return (len1 < len2) ? -1 : 1;
 }
 
+/**
+ * CompFunc for Vectors, compares element by element, the vector that has the first larger
+ * element is considered larger. If vectors are of different lengths and identify for the length
+ * of the shorter vector, the shorter vector is considered smaller.
+ * @param a - first vector
+ * @param b - second vector
+ * @return equal to 0 iff a == b. lower than 0 if a < b. Greater than 0 iff b < a.
+ */
+int vectorCompare1By1(const void *a, const void *b)
+{
+    Vector *vector1 = (Vector *) a, *vector2 = (Vector *) b;
+    return compareArrays(vector1->vector, vector1->len, vector2->vector, vector2->len);
+}
+
 /**
  * FreeFunc for vectors
  */
@@ -110,11 +429,10 @@ void freeVector(void *pVector)
     }
 }
 
-// Helper function that returns the norm^2 of the vector(assumes valid vector).
-static double getNormSquared(const Vector *vector)
+// Helper function that returns the norm^2 of an array of the given length.
+static double arrayNormSquared(const double *arr, int len)
 {
-    int len = vector->len;
-    double *arr = vector->vector, norm = 0;
+    double norm = 0;
     for (int i = 0; i < len; i++)
     {
         norm += arr[i] * arr[i];
@@ -122,6 +440,12 @@ static double getNormSquared(const Vector *vector)
     return norm;
 }
 
+// Helper function that returns the norm^2 of the vector(assumes valid vector).
+static double getNormSquared(const Vector *vector)
+{
+    return arrayNormSquared(vector->vector, vector->len);
+}
+
 /**
  * copy pVector to pMaxVector if : 1. The norm of pVector is greater then the norm of pMaxVector.
  * 								   2. pMaxVector == NULL.
@@ -137,24 +461,24 @@ int copyIfNormIsLarger(const void *pVector, void *pMaxVector)
     }
 
     Vector *vector = (Vector *) pVector, *maxVector = (Vector *) pMaxVector;
-    int flag = (maxVector->vector != NULL && (getNormSquared(vector) > getNormSquared(maxVector)));
-    if (flag)
+    if (maxVector->vector != NULL && getNormSquared(vector) <= getNormSquared(maxVector))
     {
-        free(maxVector->vector);
+        return 1;
     }
 
-    if (flag || maxVector->vector == NULL)
+    // The previous copy is reused when it is long enough, so a new maximum doesn't cost an allocation.
+    if (maxVector->vector == NULL || maxVector->len < vector->len)
     {
-        maxVector->len = vector->len;
-        maxVector->vector = (double *) malloc(sizeof(double) * vector->len);
-        if (maxVector->vector == NULL)
+        double *copy = (double *) realloc(maxVector->vector, sizeof(double) * vector->len);
+        if (copy == NULL)
         {
             return 0;
         }
-
-        memcpy(maxVector->vector, vector->vector, sizeof(double) * vector->len);
+        maxVector->vector = copy;
     }
 
+    maxVector->len = vector->len;
+    memcpy(maxVector->vector, vector->vector, sizeof(double) * vector->len);
     return 1;
 }
 
@@ -181,5 +505,652 @@ Vector *findMaxNormVectorInTree(RBTree *tree)
     return success ? maxVector : NULL;
 }
 
+// Helper function that returns the size of an InlineVector with room for len coordinates, rounded up to
+// VECTOR_ALIGNMENT so the vectors of a pool chunk stay aligned.
+static size_t inlineVectorSize(int len)
+{
+    size_t size = sizeof(InlineVector) + sizeof(double) * (size_t) len;
+    return (size + VECTOR_ALIGNMENT - 1) & ~(size_t) (VECTOR_ALIGNMENT - 1);
+}
+
+/**
+ * @param len - the length of the vectors of the pool
+ * @return a new pool of vectors of the given length, or NULL on failure.
+ */
+VectorPool *newVectorPool(int len)
+{
+    if (len < 0)
+    {
+        return NULL;
+    }
+
+    VectorPool *pool = (VectorPool *) malloc(sizeof(VectorPool));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    pool->len = len;
+    pool->vectorsPerChunk = VECTORS_PER_CHUNK;
+    pool->vectorSize = inlineVectorSize(len);
+    pool->freeVectors = NULL;
+    pool->chunks = NULL;
+    return pool;
+}
+
+/**
+ * Frees the pool and all the vectors that were taken from it.
+ */
+void freeVectorPool(VectorPool *pool)
+{
+    if (pool != NULL)
+    {
+        // Every chunk starts with a pointer to the previous one.
+        void *chunk = pool->chunks;
+        while (chunk != NULL)
+        {
+            void *previous = *(void **) chunk;
+            free(chunk);
+            chunk = previous;
+        }
+        free(pool);
+    }
+}
+
+// Helper function that adds a chunk of free vectors to the pool. Returns 0 on failure.
+static int growVectorPool(VectorPool *pool)
+{
+    void *chunk;
+    if (posix_memalign(&chunk, VECTOR_ALIGNMENT, VECTOR_ALIGNMENT + pool->vectorSize * pool->vectorsPerChunk) != 0)
+    {
+        return 0;
+    }
+
+    *(void **) chunk = pool->chunks;
+    pool->chunks = chunk;
+    for (int i = pool->vectorsPerChunk - 1; i >= 0; i--)
+    {
+        InlineVector *vector = (InlineVector *) ((char *) chunk + VECTOR_ALIGNMENT + pool->vectorSize * i);
+        vector->pool = (VectorPool *) pool->freeVectors;
+        pool->freeVectors = vector;
+    }
+    return 1;
+}
+
+/**
+ * @param pool - the pool to take the vector from, or NULL for a vector of its own
+ * @param len - the length of the vector (must be the length of the pool's vectors)
+ * @return a new InlineVector with uninitialized coordinates, or NULL on failure.
+ */
+InlineVector *newInlineVector(VectorPool *pool, int len)
+{
+    InlineVector *vector;
+    if (pool == NULL)
+    {
+        void *memory;
+        if (len < 0 || posix_memalign(&memory, VECTOR_ALIGNMENT, inlineVectorSize(len)) != 0)
+        {
+            return NULL;
+        }
+        vector = (InlineVector *) memory;
+    }
+    else
+    {
+        if (len != pool->len || (pool->freeVectors == NULL && !growVectorPool(pool)))
+        {
+            return NULL;
+        }
+
+        // Free vectors are linked through their pool field.
+        vector = pool->freeVectors;
+        pool->freeVectors = (InlineVector *) vector->pool;
+    }
+
+    vector->pool = pool;
+    vector->len = vector->capacity = len;
+    return vector;
+}
+
+/**
+ * @param pVector - the InlineVector to copy
+ * @param pool - the pool to take the copy from, or NULL for a vector of its own
+ * @return a new copy of the vector, or NULL on failure.
+ */
+InlineVector *copyInlineVector(const InlineVector *pVector, VectorPool *pool)
+{
+    if (pVector == NULL)
+    {
+        return NULL;
+    }
+
+    InlineVector *copy = newInlineVector(pool, pVector->len);
+    if (copy != NULL)
+    {
+        memcpy(copy->vector, pVector->vector, sizeof(double) * pVector->len);
+    }
+    return copy;
+}
+
+/**
+ * CompFunc for InlineVectors, compares like vectorCompare1By1.
+ * @param a - first vector
+ * @param b - second vector
+ * @return equal to 0 iff a == b. lower than 0 if a < b. Greater than 0 iff b < a.
+ */
+int inlineVectorCompare1By1(const void *a, const void *b)
+{
+    const InlineVector *vector1 = (const InlineVector *) a, *vector2 = (const InlineVector *) b;
+    return compareArrays(vector1->vector, vector1->len, vector2->vector, vector2->len);
+}
+
+/**
+ * FreeFunc for InlineVectors (returns vectors to their pool).
+ */
+void freeInlineVector(void *pVector)
+{
+    if (pVector != NULL)
+    {
+        InlineVector *vector = (InlineVector *) pVector;
+        VectorPool *pool = vector->pool;
+        if (pool == NULL)
+        {
+            free(vector);
+            return;
+        }
+
+        vector->pool = (VectorPool *) pool->freeVectors;
+        pool->freeVectors = vector;
+    }
+}
+
+/**
+ * ForEach function like copyIfNormIsLarger, for InlineVectors.
+ * @param pVector pointer to InlineVector
+ * @param pMaxVector pointer to InlineMaxVector
+ * @return 1 on success, 0 on failure (if pVector == NULL: failure).
+ */
+int copyIfInlineNormIsLarger(const void *pVector, void *pMaxVector)
+{
+    if (pVector == NULL || pMaxVector == NULL)
+    {
+        return 0;
+    }
+
+    const InlineVector *vector = (const InlineVector *) pVector;
+    InlineMaxVector *maxVector = (InlineMaxVector *) pMaxVector;
+    double normSquared = arrayNormSquared(vector->vector, vector->len);
+    if (maxVector->max != NULL && normSquared <= maxVector->normSquared)
+    {
+        return 1;
+    }
+
+    // The copy is overwritten in place unless it is too short for the new maximum.
+    if (maxVector->max == NULL || maxVector->max->capacity < vector->len)
+    {
+        InlineVector *copy = newInlineVector(NULL, vector->len);
+        if (copy == NULL)
+        {
+            return 0;
+        }
+        free(maxVector->max);
+        maxVector->max = copy;
+    }
+
+    maxVector->max->len = vector->len;
+    memcpy(maxVector->max->vector, vector->vector, sizeof(double) * vector->len);
+    maxVector->normSquared = normSquared;
+    return 1;
+}
+
+/**
+ * @param tree a pointer to a tree of InlineVectors
+ * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm), not from any pool.
+ */
+InlineVector *findMaxNormInlineVectorInTree(RBTree *tree)
+{
+    if (tree == NULL || tree->root == NULL)
+    {
+        return NULL;
+    }
+
+    InlineMaxVector maxVector = {NULL, 0};
+    if (!forEachRBTree(tree, copyIfInlineNormIsLarger, &maxVector))
+    {
+        free(maxVector.max);
+        return NULL;
+    }
+    return maxVector.max;
+}
+
+// Helper function that returns the middle of the range [low, high) of a k-d tree (the root of its subtree).
+static int middleOf(int low, int high)
+{
+    return low + (high - low) / 2;
+}
+
+// Helper function that returns the squared L2 distance of two vectors of the same length. Stops adding as
+// soon as the sum passes bound, since the caller doesn't care how far beyond bound the vectors are.
+static double getDistanceSquared(const Vector *a, const Vector *b, double bound)
+{
+    int len = a->len;
+    double *arr1 = a->vector, *arr2 = b->vector, distance = 0;
+    for (int i = 0; i < len && distance <= bound; i++)
+    {
+        double diff = arr1[i] - arr2[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+// Helper function that reorders vectors[low, high) so the one at middle is where it would be if the range
+// were sorted by the given coordinate, with smaller ones before it and larger ones after it (quickselect).
+static void selectMedian(Vector **vectors, int low, int high, int middle, int axis)
+{
+    while (high - low > 1)
+    {
+        double pivot = vectors[middleOf(low, high)]->vector[axis];
+        int i = low, j = high - 1;
+        while (i <= j)
+        {
+            while (vectors[i]->vector[axis] < pivot)
+            {
+                i++;
+            }
+            while (vectors[j]->vector[axis] > pivot)
+            {
+                j--;
+            }
+            if (i <= j)
+            {
+                Vector *temp = vectors[i];
+                vectors[i++] = vectors[j];
+                vectors[j--] = temp;
+            }
+        }
+
+        if (middle <= j)
+        {
+            high = j + 1;
+        }
+        else if (middle >= i)
+        {
+            low = i;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+// Helper recursive function that builds the subtree of the range [low, high) and its largest norms.
+static void buildKDTree(KDTree *kdTree, int low, int high, int depth)
+{
+    if (low >= high)
+    {
+        return;
+    }
+
+    int middle = middleOf(low, high);
+    selectMedian(kdTree->vectors, low, high, middle, depth % kdTree->dim);
+    buildKDTree(kdTree, low, middle, depth + 1);
+    buildKDTree(kdTree, middle + 1, high, depth + 1);
+
+    double maxNorm = kdTree->normSquared[middle] = getNormSquared(kdTree->vectors[middle]);
+    if (low < middle && kdTree->maxNormSquared[middleOf(low, middle)] > maxNorm)
+    {
+        maxNorm = kdTree->maxNormSquared[middleOf(low, middle)];
+    }
+    if (middle + 1 < high && kdTree->maxNormSquared[middleOf(middle + 1, high)] > maxNorm)
+    {
+        maxNorm = kdTree->maxNormSquared[middleOf(middle + 1, high)];
+    }
+    kdTree->maxNormSquared[middle] = maxNorm;
+}
+
+// Helper function that builds a k-d tree from a copy of the given array of vectors.
+static KDTree *buildKDTreeFromArray(Vector *const *vectors, int n, int ownsVectors)
+{
+    if (vectors == NULL || n < 0 || (n > 0 && (vectors[0] == NULL || vectors[0]->len <= 0)))
+    {
+        return NULL;
+    }
+    for (int i = 1; i < n; i++)
+    {
+        if (vectors[i] == NULL || vectors[i]->len != vectors[0]->len)
+        {
+            return NULL;
+        }
+    }
+
+    KDTree *kdTree = (KDTree *) malloc(sizeof(KDTree));
+    if (kdTree == NULL)
+    {
+        return NULL;
+    }
+
+    kdTree->size = n;
+    kdTree->dim = (n > 0) ? vectors[0]->len : 0;
+    kdTree->ownsVectors = ownsVectors;
+    kdTree->vectors = (Vector **) malloc(sizeof(Vector *) * (n + 1));
+    kdTree->normSquared = (double *) malloc(sizeof(double) * (n + 1));
+    kdTree->maxNormSquared = (double *) malloc(sizeof(double) * (n + 1));
+    if (kdTree->vectors == NULL || kdTree->normSquared == NULL || kdTree->maxNormSquared == NULL)
+    {
+        free(kdTree->vectors);
+        free(kdTree->normSquared);
+        free(kdTree->maxNormSquared);
+        free(kdTree);
+        return NULL;
+    }
+
+    memcpy(kdTree->vectors, vectors, sizeof(Vector *) * n);
+    buildKDTree(kdTree, 0, n, 0);
+    return kdTree;
+}
+
+/**
+ * Builds a k-d tree from the given vectors by splitting at the median. The tree takes ownership of the
+ * vectors (they are freed with freeVector in freeKDTree), but not of the array.
+ * @param vectors - array of n pointers to Vectors, all with the same positive length
+ * @param n - number of vectors
+ * @return the new k-d tree, or NULL on failure.
+ */
+KDTree *newKDTree(Vector **vectors, int n)
+{
+    return buildKDTreeFromArray(vectors, n, 1);
+}
+
+// ForEach function that appends the vector to the array pointed to by pCursor.
+static int collectVector(const void *pVector, void *pCursor)
+{
+    Vector ***cursor = (Vector ***) pCursor;
+    *((*cursor)++) = (Vector *) pVector;
+    return 1;
+}
+
+/**
+ * Builds a k-d tree over the Vectors of a tree, as an index next to it. The vectors still belong to the
+ * tree, so the k-d tree must be freed before the tree changes.
+ * @param tree a pointer to a tree of Vectors, all with the same positive length
+ * @return the new k-d tree, or NULL on failure.
+ */
+KDTree *newKDTreeFromRBTree(RBTree *tree)
+{
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    Vector **vectors = (Vector **) malloc(sizeof(Vector *) * (tree->size + 1));
+    if (vectors == NULL)
+    {
+        return NULL;
+    }
+
+    Vector **cursor = vectors;
+    forEachRBTree(tree, collectVector, &cursor);
+    KDTree *kdTree = buildKDTreeFromArray(vectors, tree->size, 0);
+    free(vectors);
+    return kdTree;
+}
+
+// Helper function that moves heap entry i towards the top until its parent is farther than it.
+static void siftUp(NeighbourHeap *heap, int i)
+{
+    while (i > 0 && heap->distances[(i - 1) / 2] < heap->distances[i])
+    {
+        int parent = (i - 1) / 2;
+        double distance = heap->distances[i];
+        Vector *vector = heap->vectors[i];
+        heap->distances[i] = heap->distances[parent];
+        heap->vectors[i] = heap->vectors[parent];
+        heap->distances[parent] = distance;
+        heap->vectors[parent] = vector;
+        i = parent;
+    }
+}
+
+// Helper function that moves heap entry i towards the bottom until its sons are closer than it.
+static void siftDown(NeighbourHeap *heap, int i)
+{
+    while (2 * i + 1 < heap->size)
+    {
+        int son = 2 * i + 1;
+        if (son + 1 < heap->size && heap->distances[son + 1] > heap->distances[son])
+        {
+            son++;
+        }
+        if (heap->distances[son] <= heap->distances[i])
+        {
+            return;
+        }
+
+        double distance = heap->distances[i];
+        Vector *vector = heap->vectors[i];
+        heap->distances[i] = heap->distances[son];
+        heap->vectors[i] = heap->vectors[son];
+        heap->distances[son] = distance;
+        heap->vectors[son] = vector;
+        i = son;
+    }
+}
+
+// Helper function that keeps the vector if there is still room or it is closer than the farthest one kept.
+static void offerNeighbour(NeighbourHeap *heap, Vector *vector, double distance)
+{
+    if (heap->size < heap->capacity)
+    {
+        heap->vectors[heap->size] = vector;
+        heap->distances[heap->size] = distance;
+        siftUp(heap, heap->size++);
+    }
+    else if (distance < heap->distances[0])
+    {
+        heap->vectors[0] = vector;
+        heap->distances[0] = distance;
+        siftDown(heap, 0);
+    }
+}
+
+// Helper function that returns the squared distance a vector must beat to be kept by the heap.
+static double neighbourBound(const NeighbourHeap *heap)
+{
+    return (heap->size < heap->capacity) ? DBL_MAX : heap->distances[0];
+}
+
+// Helper recursive function for the nearest neighbours search. Visits the side of the split that holds the
+// query first, and the other side only if the split is closer than the farthest neighbour kept.
+static void nearestHelper(const KDTree *kdTree, const Vector *query, int low, int high, int depth,
+                          NeighbourHeap *heap)
+{
+    if (low >= high)
+    {
+        return;
+    }
+
+    int middle = middleOf(low, high), axis = depth % kdTree->dim;
+    Vector *current = kdTree->vectors[middle];
+    double bound = neighbourBound(heap);
+    double distance = getDistanceSquared(query, current, bound);
+    if (distance < bound)
+    {
+        offerNeighbour(heap, current, distance);
+    }
+
+    double diff = query->vector[axis] - current->vector[axis];
+    if (diff < 0)
+    {
+        nearestHelper(kdTree, query, low, middle, depth + 1, heap);
+        if (diff * diff < neighbourBound(heap))
+        {
+            nearestHelper(kdTree, query, middle + 1, high, depth + 1, heap);
+        }
+    }
+    else
+    {
+        nearestHelper(kdTree, query, middle + 1, high, depth + 1, heap);
+        if (diff * diff < neighbourBound(heap))
+        {
+            nearestHelper(kdTree, query, low, middle, depth + 1, heap);
+        }
+    }
+}
+
+/**
+ * Finds the k vectors closest to query (L2 distance).
+ * @param kdTree - the k-d tree to search
+ * @param query - a Vector with the same length as the vectors of the tree
+ * @param k - number of vectors to find
+ * @param results - filled with the found vectors, closest first (must have room for k pointers)
+ * @return the number of vectors found (less than k only if the tree is smaller), or -1 on failure.
+ */
+int nearestVectorsKDTree(const KDTree *kdTree, const Vector *query, int k, Vector **results)
+{
+    if (kdTree == NULL || query == NULL || results == NULL || k < 0 ||
+        (kdTree->size > 0 && query->len != kdTree->dim))
+    {
+        return -1;
+    }
+
+    NeighbourHeap heap;
+    heap.size = 0;
+    heap.capacity = (k < kdTree->size) ? k : kdTree->size;
+    heap.distances = (double *) malloc(sizeof(double) * (heap.capacity + 1));
+    if (heap.distances == NULL)
+    {
+        return -1;
+    }
+    heap.vectors = results;
+
+    if (heap.capacity > 0)
+    {
+        nearestHelper(kdTree, query, 0, kdTree->size, 0, &heap);
+    }
+
+    // Popping the farthest neighbour to the end of the heap's array each time sorts it closest first.
+    int found = heap.size;
+    while (heap.size > 1)
+    {
+        heap.size--;
+        double distance = heap.distances[0];
+        Vector *vector = heap.vectors[0];
+        heap.distances[0] = heap.distances[heap.size];
+        heap.vectors[0] = heap.vectors[heap.size];
+        heap.distances[heap.size] = distance;
+        heap.vectors[heap.size] = vector;
+        siftDown(&heap, 0);
+    }
+
+    free(heap.distances);
+    return found;
+}
+
+// Helper recursive function for the radius search. Skips the side of the split that is too far away.
+static int radiusHelper(const KDTree *kdTree, const Vector *query, double radiusSquared, int low, int high,
+                        int depth, forEachFunc func, void *args)
+{
+    if (low >= high)
+    {
+        return 1;
+    }
+
+    int middle = middleOf(low, high), axis = depth % kdTree->dim;
+    Vector *current = kdTree->vectors[middle];
+    if (getDistanceSquared(query, current, radiusSquared) <= radiusSquared && !func(current, args))
+    {
+        return 0;
+    }
+
+    double diff = query->vector[axis] - current->vector[axis];
+    if (diff <= 0 || diff * diff <= radiusSquared)
+    {
+        if (!radiusHelper(kdTree, query, radiusSquared, low, middle, depth + 1, func, args))
+        {
+            return 0;
+        }
+    }
+    if (diff >= 0 || diff * diff <= radiusSquared)
+    {
+        return radiusHelper(kdTree, query, radiusSquared, middle + 1, high, depth + 1, func, args);
+    }
+    return 1;
+}
+
+/**
+ * Activates a function on each vector whose L2 distance from query is at most radius. if one of the
+ * activations of the function returns 0, the process stops.
+ * @param kdTree - the k-d tree to search
+ * @param query - a Vector with the same length as the vectors of the tree
+ * @param radius - the maximal distance
+ * @param func - the function to activate on the vectors
+ * @param args - more optional arguments to the function
+ * @return 0 on failure, other on success.
+ */
+int forEachInRadiusKDTree(const KDTree *kdTree, const Vector *query, double radius, forEachFunc func, void *args)
+{
+    if (kdTree == NULL || query == NULL || func == NULL || radius < 0 ||
+        (kdTree->size > 0 && query->len != kdTree->dim))
+    {
+        return 0;
+    }
+    return radiusHelper(kdTree, query, radius * radius, 0, kdTree->size, 0, func, args);
+}
+
+/**
+ * Finds the vector with the largest norm (L2 Norm) in O(log n), using the largest norm of every subtree.
+ * @param kdTree - the k-d tree to search
+ * @return pointer to the vector itself (not a copy), or NULL if the tree is empty.
+ */
+Vector *findMaxNormVectorInKDTree(const KDTree *kdTree)
+{
+    if (kdTree == NULL)
+    {
+        return NULL;
+    }
+
+    // Follow the subtrees whose largest norm is the largest norm of the whole tree.
+    int low = 0, high = kdTree->size;
+    while (low < high)
+    {
+        int middle = middleOf(low, high);
+        if (kdTree->normSquared[middle] == kdTree->maxNormSquared[middle])
+        {
+            return kdTree->vectors[middle];
+        }
+
+        if (low < middle && kdTree->maxNormSquared[middleOf(low, middle)] == kdTree->maxNormSquared[middle])
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Frees the k-d tree, and the vectors too if it owns them.
+ */
+void freeKDTree(KDTree *kdTree)
+{
+    if (kdTree != NULL)
+    {
+        if (kdTree->ownsVectors)
+        {
+            for (int i = 0; i < kdTree->size; i++)
+            {
+                freeVector(kdTree->vectors[i]);
+            }
+        }
+        free(kdTree->vectors);
+        free(kdTree->normSquared);
+        free(kdTree->maxNormSquared);
+        free(kdTree);
+    }
+}
+
 
 #endif //TA_EX3_STRUCTS_H
@@ -21,6 +21,40 @@ typedef struct Vector
 	double *vector;
 } Vector;
 
+/**
+ * A Vector stored in a single allocation: the header is padded to 32 bytes and followed by the coordinates,
+ * which are 32 byte aligned for AVX loads. Vectors taken from a VectorPool remember it, so freeInlineVector
+ * returns them there. capacity is the number of coordinates there is room for (at least len).
+ */
+typedef struct InlineVector
+{
+	struct VectorPool *pool;
+	int len, capacity;
+	char padding[32 - sizeof(struct VectorPool *) - 2 * sizeof(int)];
+	double vector[];
+} InlineVector;
+
+/**
+ * Hands out InlineVectors of one length from large chunks, and keeps the freed ones for reuse.
+ */
+typedef struct VectorPool
+{
+	int len, vectorsPerChunk;
+	size_t vectorSize;
+	InlineVector *freeVectors;
+	void *chunks;
+} VectorPool;
+
+/**
+ * Tracks the InlineVector with the largest norm seen by copyIfInlineNormIsLarger. max is a copy that is
+ * overwritten in place whenever it has room for the new maximum. Start with max == NULL.
+ */
+typedef struct InlineMaxVector
+{
+	InlineVector *max;
+	double normSquared;
+} InlineMaxVector;
+
 
 /**
  * CompFunc for strings (assumes strings end with "\0")
@@ -31,6 +65,14 @@ typedef struct Vector
  */
 int stringCompare(const void *a, const void *b); // implement it in Structs.c
 
+/**
+ * KeyExtractFunc for strings that keeps the order of stringCompare: the first 8 characters as a big endian
+ * number (shorter strings are padded with zeros).
+ * @param s - char* pointer
+ * @return the normalized key of s
+ */
+uint64_t stringKey(const void *s);
+
 /**
  * ForEach function that concatenates the given word to pConcatenated. pConcatenated is already allocated with
  * enough space.
@@ -40,6 +82,69 @@ int stringCompare(const void *a, const void *b); // implement it in Structs.c
  */
 int concatenate(const void *word, void *pConcatenated); // implement it in Structs.c
 
+/**
+ * Where exported strings are written: a buffer that is filled from length on and, if fd >= 0, written to fd
+ * whenever it gets full. Otherwise a full buffer is reallocated to twice its size if isGrowable, or the
+ * export fails. (exportStringsToBuffer, exportStringsGrowable and exportStringsToFd set one up; a growable
+ * cursor may also start as {NULL, 0, 0, 1, -1}, and its buffer then needs to be freed)
+ */
+typedef struct StringCursor
+{
+	char *buffer;
+	size_t length, capacity;
+	int isGrowable, fd;
+} StringCursor;
+
+/**
+ * ForEach function like concatenate, that writes the given word and "\n" at the cursor instead of searching
+ * for the end of the string, so exporting a tree takes linear time.
+ * @param word - char* to write
+ * @param pCursor - StringCursor*
+ * @return 0 on failure, other on success
+ */
+int concatenateAt(const void *word, void *pCursor); // implement it in Structs.c
+
+/**
+ * @param tree a pointer to a tree of strings
+ * @return the exact number of characters exporting the tree writes (each string and "\n", without the
+ * final "\0").
+ */
+size_t exportedStringsLength(RBTree *tree); // implement it in Structs.c
+
+/**
+ * Writes the strings of the tree in ascending order, each followed by "\n", to the given buffer.
+ * @param tree a pointer to a tree of strings
+ * @param buffer where to write, it ends with "\0"
+ * @param capacity the size of buffer
+ * @return 1 on success, 0 on failure (if the buffer is too small).
+ */
+int exportStringsToBuffer(RBTree *tree, char *buffer, size_t capacity); // implement it in Structs.c
+
+/**
+ * @param tree a pointer to a tree of strings
+ * @return a new string (needs to be freed) of exactly the right size with the strings of the tree in
+ * ascending order, each followed by "\n". NULL on failure.
+ */
+char *exportStrings(RBTree *tree); // implement it in Structs.c
+
+/**
+ * Writes the strings of the tree in ascending order, each followed by "\n", to a file descriptor, with
+ * large buffered writes.
+ * @param tree a pointer to a tree of strings
+ * @param fd an open file descriptor
+ * @return 1 on success, 0 on failure.
+ */
+int exportStringsToFd(RBTree *tree, int fd); // implement it in Structs.c
+
+/**
+ * Writes the strings of the tree in ascending order, each followed by "\n", to a new buffer that grows as
+ * needed, so the tree is walked only once (exportStrings measures it first).
+ * @param tree a pointer to a tree of strings
+ * @param pLength if not NULL, set to the length of the result (without the final "\0")
+ * @return a new string (needs to be freed), or NULL on failure.
+ */
+char *exportStringsGrowable(RBTree *tree, size_t *pLength);
+
 /**
  * FreeFunc for strings
  */
@@ -75,5 +180,120 @@ int copyIfNormIsLarger(const void *pVector, void *pMaxVector); // implement it i
  */
 Vector *findMaxNormVectorInTree(RBTree *tree); // implement it in Structs.c You must use copyIfNormIsLarger in the implementation!
 
+/**
+ * @param len - the length of the vectors of the pool
+ * @return a new pool of vectors of the given length, or NULL on failure.
+ */
+VectorPool *newVectorPool(int len); // implement it in Structs.c
+
+/**
+ * Frees the pool and all the vectors that were taken from it.
+ */
+void freeVectorPool(VectorPool *pool); // implement it in Structs.c
+
+/**
+ * @param pool - the pool to take the vector from, or NULL for a vector of its own
+ * @param len - the length of the vector (must be the length of the pool's vectors)
+ * @return a new InlineVector with uninitialized coordinates, or NULL on failure.
+ */
+InlineVector *newInlineVector(VectorPool *pool, int len); // implement it in Structs.c
+
+/**
+ * @param pVector - the InlineVector to copy
+ * @param pool - the pool to take the copy from, or NULL for a vector of its own
+ * @return a new copy of the vector, or NULL on failure.
+ */
+InlineVector *copyInlineVector(const InlineVector *pVector, VectorPool *pool); // implement it in Structs.c
+
+/**
+ * CompFunc for InlineVectors, compares like vectorCompare1By1.
+ * @param a - first vector
+ * @param b - second vector
+ * @return equal to 0 iff a == b. lower than 0 if a < b. Greater than 0 iff b < a.
+ */
+int inlineVectorCompare1By1(const void *a, const void *b); // implement it in Structs.c
+
+/**
+ * FreeFunc for InlineVectors (returns vectors to their pool).
+ */
+void freeInlineVector(void *pVector); // implement it in Structs.c
+
+/**
+ * ForEach function like copyIfNormIsLarger, for InlineVectors.
+ * @param pVector pointer to InlineVector
+ * @param pMaxVector pointer to InlineMaxVector
+ * @return 1 on success, 0 on failure (if pVector == NULL: failure).
+ */
+int copyIfInlineNormIsLarger(const void *pVector, void *pMaxVector); // implement it in Structs.c
+
+/**
+ * @param tree a pointer to a tree of InlineVectors
+ * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm), not from any pool.
+ */
+InlineVector *findMaxNormInlineVectorInTree(RBTree *tree); // implement it in Structs.c
+
+/**
+ * A k-d tree over Vectors of the same length, for nearest neighbour and radius queries with the L2
+ * distance. The vectors are kept in one array, with the median of every range at its middle and the ranges
+ * on each side of it as its subtrees (split by coordinate depth % dim).
+ */
+typedef struct KDTree
+{
+	Vector **vectors;
+	double *normSquared, *maxNormSquared;
+	int size, dim, ownsVectors;
+} KDTree;
+
+/**
+ * Builds a k-d tree from the given vectors by splitting at the median. The tree takes ownership of the
+ * vectors (they are freed with freeVector in freeKDTree), but not of the array.
+ * @param vectors - array of n pointers to Vectors, all with the same positive length
+ * @param n - number of vectors
+ * @return the new k-d tree, or NULL on failure.
+ */
+KDTree *newKDTree(Vector **vectors, int n);
+
+/**
+ * Builds a k-d tree over the Vectors of a tree, as an index next to it. The vectors still belong to the
+ * tree, so the k-d tree must be freed before the tree changes.
+ * @param tree a pointer to a tree of Vectors, all with the same positive length
+ * @return the new k-d tree, or NULL on failure.
+ */
+KDTree *newKDTreeFromRBTree(RBTree *tree);
+
+/**
+ * Finds the k vectors closest to query (L2 distance).
+ * @param kdTree - the k-d tree to search
+ * @param query - a Vector with the same length as the vectors of the tree
+ * @param k - number of vectors to find
+ * @param results - filled with the found vectors, closest first (must have room for k pointers)
+ * @return the number of vectors found (less than k only if the tree is smaller), or -1 on failure.
+ */
+int nearestVectorsKDTree(const KDTree *kdTree, const Vector *query, int k, Vector **results);
+
+/**
+ * Activates a function on each vector whose L2 distance from query is at most radius. if one of the
+ * activations of the function returns 0, the process stops.
+ * @param kdTree - the k-d tree to search
+ * @param query - a Vector with the same length as the vectors of the tree
+ * @param radius - the maximal distance
+ * @param func - the function to activate on the vectors
+ * @param args - more optional arguments to the function
+ * @return 0 on failure, other on success.
+ */
+int forEachInRadiusKDTree(const KDTree *kdTree, const Vector *query, double radius, forEachFunc func, void *args);
+
+/**
+ * Finds the vector with the largest norm (L2 Norm) in O(log n), using the largest norm of every subtree.
+ * @param kdTree - the k-d tree to search
+ * @return pointer to the vector itself (not a copy), or NULL if the tree is empty.
+ */
+Vector *findMaxNormVectorInKDTree(const KDTree *kdTree);
+
+/**
+ * Frees the k-d tree, and the vectors too if it owns them.
+ */
+void freeKDTree(KDTree *kdTree);
+
 
 #endif //TA_EX3_STRUCTS_H
@@ -0,0 +1,357 @@
+//
+// Tests for the example structs.
+//
+
+#ifndef TA_EX3_STRUCTSEXAMPLE_C
+#define TA_EX3_STRUCTSEXAMPLE_C
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "Structs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define DIM 3
+#define VECTORS 500
+#define QUERIES 50
+#define NEIGHBOURS 7
+// Number of InlineVectors taken from the pool, more than fit in one of its chunks.
+#define POOLED 150
+// Longer than the buffer of exportStringsToFd, so the word is written past it.
+#define LONG_WORD 70000
+
+/**
+ * @return the next number of a simple linear congruential generator, between 0 and 1
+ */
+double nextCoordinate(unsigned int *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (double) (*state >> 8) / (double) (1u << 24);
+}
+
+/**
+ * @return a new random Vector of the given length (freed with freeVector)
+ */
+Vector *newRandomVector(int len, unsigned int *state)
+{
+    Vector *pVector = (Vector *) malloc(sizeof(Vector));
+    pVector->len = len;
+    pVector->vector = (double *) malloc(sizeof(double) * len);
+    for (int i = 0; i < len; i++)
+    {
+        pVector->vector[i] = nextCoordinate(state) * 2 - 1;
+    }
+    return pVector;
+}
+
+/**
+ * @return the squared L2 distance between two vectors of the same length
+ */
+double distanceSquared(const Vector *a, const Vector *b)
+{
+    double sum = 0;
+    for (int i = 0; i < a->len; i++)
+    {
+        double difference = a->vector[i] - b->vector[i];
+        sum += difference * difference;
+    }
+    return sum;
+}
+
+/**
+ * Arguments of countInRadius: the query, the radius and the number of vectors found.
+ */
+typedef struct RadiusCount
+{
+    const Vector *query;
+    double radius;
+    int count, isValid;
+} RadiusCount;
+
+/**
+ * ForEach function that counts the vectors found in the radius and checks that they are in it.
+ */
+int countInRadius(const void *pVector, void *pCount)
+{
+    RadiusCount *count = (RadiusCount *) pCount;
+    count->count++;
+    if (distanceSquared((const Vector *) pVector, count->query) > count->radius * count->radius)
+    {
+        count->isValid = 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks the nearest neighbours, radius queries and largest norm of a k-d tree against brute force.
+ * @return 1 if they all agree, 0 otherwise
+ */
+int testKDTree()
+{
+    unsigned int state = 2463534242u;
+    Vector **vectors = (Vector **) malloc(sizeof(Vector *) * VECTORS);
+    for (int i = 0; i < VECTORS; i++)
+    {
+        vectors[i] = newRandomVector(DIM, &state);
+    }
+    Vector *origin = newRandomVector(DIM, &state);
+    memset(origin->vector, 0, sizeof(double) * DIM);
+
+    // The largest norm is the vector farthest from the origin.
+    Vector *maxVector = vectors[0];
+    for (int i = 1; i < VECTORS; i++)
+    {
+        if (distanceSquared(vectors[i], origin) > distanceSquared(maxVector, origin))
+        {
+            maxVector = vectors[i];
+        }
+    }
+
+    KDTree *kdTree = newKDTree(vectors, VECTORS);
+    int passed = kdTree != NULL && kdTree->size == VECTORS && findMaxNormVectorInKDTree(kdTree) == maxVector;
+
+    Vector *results[NEIGHBOURS];
+    for (int q = 0; passed && q < QUERIES; q++)
+    {
+        Vector *query = newRandomVector(DIM, &state);
+        passed = nearestVectorsKDTree(kdTree, query, NEIGHBOURS, results) == NEIGHBOURS;
+
+        // The results come closest first, and no other vector is closer than the last of them.
+        for (int i = 1; passed && i < NEIGHBOURS; i++)
+        {
+            passed = distanceSquared(results[i - 1], query) <= distanceSquared(results[i], query);
+        }
+        int closer = 0;
+        for (int i = 0; passed && i < VECTORS; i++)
+        {
+            closer += distanceSquared(vectors[i], query) < distanceSquared(results[NEIGHBOURS - 1], query);
+        }
+        passed = passed && closer == NEIGHBOURS - 1;
+
+        RadiusCount count = {query, 0.3, 0, 1};
+        int expected = 0;
+        for (int i = 0; i < VECTORS; i++)
+        {
+            expected += distanceSquared(vectors[i], query) <= count.radius * count.radius;
+        }
+        passed = passed && forEachInRadiusKDTree(kdTree, query, count.radius, countInRadius, &count) &&
+                 count.isValid && count.count == expected;
+        freeVector(query);
+    }
+
+    // Asking for more neighbours than there are vectors finds all of them.
+    Vector **all = (Vector **) malloc(sizeof(Vector *) * (VECTORS + 1));
+    passed = passed && nearestVectorsKDTree(kdTree, origin, VECTORS + 1, all) == VECTORS &&
+             all[VECTORS - 1] == maxVector;
+    free(all);
+
+    if (!passed)
+    {
+        printf("The k-d tree doesn't agree with brute force.\n");
+    }
+    freeKDTree(kdTree);
+    freeVector(origin);
+    free(vectors);
+    return passed;
+}
+
+/**
+ * Checks that a k-d tree built next to a tree of Vectors finds its vectors without taking them.
+ * @return 1 if it does, 0 otherwise
+ */
+int testKDTreeFromRBTree()
+{
+    unsigned int state = 88172645u;
+    RBTree *tree = newRBTree(vectorCompare1By1, freeVector);
+    for (int i = 0; i < VECTORS; i++)
+    {
+        Vector *pVector = newRandomVector(DIM, &state);
+        if (!addToRBTree(tree, pVector))
+        {
+            freeVector(pVector);
+        }
+    }
+
+    KDTree *kdTree = newKDTreeFromRBTree(tree);
+    Vector *maxVector = findMaxNormVectorInTree(tree);
+    Vector *found = (kdTree != NULL) ? findMaxNormVectorInKDTree(kdTree) : NULL;
+    int passed = found != NULL && kdTree->size == tree->size && containsRBTree(tree, found) &&
+                 vectorCompare1By1(found, maxVector) == 0;
+
+    Vector *nearest = NULL;
+    passed = passed && nearestVectorsKDTree(kdTree, maxVector, 1, &nearest) == 1 && nearest == found;
+
+    if (!passed)
+    {
+        printf("The k-d tree of a tree doesn't agree with the tree.\n");
+    }
+    freeVector(maxVector);
+    freeKDTree(kdTree);
+    freeRBTree(tree);
+    return passed;
+}
+
+/**
+ * @return 1 if the coordinates of the vector are aligned for AVX loads, 0 otherwise
+ */
+int isAligned(const InlineVector *pVector)
+{
+    return (uintptr_t) pVector->vector % 32 == 0;
+}
+
+/**
+ * Checks that InlineVectors from a pool and of their own are aligned, copied and reused, and that the
+ * largest norm of a tree of them matches the one of the same Vectors.
+ * @return 1 if they are, 0 otherwise
+ */
+int testInlineVectors()
+{
+    unsigned int state = 521288629u;
+    VectorPool *pool = newVectorPool(DIM);
+    RBTree *tree = newRBTree(inlineVectorCompare1By1, freeInlineVector);
+    RBTree *vectorTree = newRBTree(vectorCompare1By1, freeVector);
+    int passed = pool != NULL && newInlineVector(pool, DIM + 1) == NULL;
+
+    InlineVector *vectors[POOLED];
+    for (int i = 0; passed && i < POOLED; i++)
+    {
+        Vector *pVector = newRandomVector(DIM, &state);
+        vectors[i] = newInlineVector(pool, DIM);
+        passed = vectors[i] != NULL && vectors[i]->pool == pool && vectors[i]->len == DIM && isAligned(vectors[i]);
+        if (passed)
+        {
+            memcpy(vectors[i]->vector, pVector->vector, sizeof(double) * DIM);
+            addToRBTree(tree, vectors[i]);
+        }
+        if (!addToRBTree(vectorTree, pVector))
+        {
+            freeVector(pVector);
+        }
+    }
+
+    // A vector returned to the pool is the next one handed out.
+    InlineVector *copy = passed ? copyInlineVector(vectors[0], pool) : NULL;
+    passed = copy != NULL && copy->pool == pool && inlineVectorCompare1By1(copy, vectors[0]) == 0;
+    freeInlineVector(copy);
+    passed = passed && newInlineVector(pool, DIM) == copy;
+
+    InlineVector *ownCopy = passed ? copyInlineVector(vectors[1], NULL) : NULL;
+    passed = ownCopy != NULL && ownCopy->pool == NULL && isAligned(ownCopy) &&
+             inlineVectorCompare1By1(ownCopy, vectors[1]) == 0;
+    freeInlineVector(ownCopy);
+
+    // The copy of the maximum is overwritten in place, and replaced when it is too short.
+    InlineMaxVector maxVector = {NULL, 0};
+    passed = passed && copyIfInlineNormIsLarger(vectors[0], &maxVector) && maxVector.max != NULL;
+    InlineVector *firstMax = maxVector.max;
+    for (int i = 1; passed && i < POOLED; i++)
+    {
+        passed = copyIfInlineNormIsLarger(vectors[i], &maxVector) && maxVector.max == firstMax;
+    }
+    InlineVector *longer = newInlineVector(NULL, DIM + 1);
+    if (passed && longer != NULL)
+    {
+        memset(longer->vector, 0, sizeof(double) * (DIM + 1));
+        longer->vector[DIM] = 10;
+        passed = copyIfInlineNormIsLarger(longer, &maxVector) && maxVector.max->len == DIM + 1 &&
+                 maxVector.max->capacity >= DIM + 1 && maxVector.normSquared == 100;
+    }
+    freeInlineVector(longer);
+    free(maxVector.max);
+
+    InlineVector *max = findMaxNormInlineVectorInTree(tree);
+    Vector *expected = findMaxNormVectorInTree(vectorTree);
+    passed = passed && max != NULL && expected != NULL && max->pool == NULL && max->len == DIM &&
+             memcmp(max->vector, expected->vector, sizeof(double) * DIM) == 0;
+    freeInlineVector(max);
+    freeVector(expected);
+
+    if (!passed)
+    {
+        printf("The inline vectors don't match the vectors.\n");
+    }
+    freeRBTree(vectorTree);
+    freeRBTree(tree);
+    freeVectorPool(pool);
+    return passed;
+}
+
+/**
+ * Checks that every way of exporting a tree of strings writes the same text as concatenate.
+ * @return 1 if they do, 0 otherwise
+ */
+int testExportStrings()
+{
+    RBTree *tree = newRBTree(stringCompare, freeString);
+    const char *words[4] = {"banana", "apple", "cherry", ""};
+    for (int i = 0; i < 4; i++)
+    {
+        char *word = (char *) malloc(strlen(words[i]) + 1);
+        strcpy(word, words[i]);
+        addToRBTree(tree, word);
+    }
+    char *longWord = (char *) malloc(LONG_WORD + 1);
+    memset(longWord, 'z', LONG_WORD);
+    longWord[LONG_WORD] = '\0';
+    addToRBTree(tree, longWord);
+
+    size_t length = exportedStringsLength(tree);
+    char *expected = (char *) calloc(length + 1, 1);
+    forEachRBTree(tree, concatenate, expected);
+    int passed = length == strlen(expected) && length == 2 + 6 + 7 + 7 + LONG_WORD;
+
+    // The buffer needs room for the final "\0" too.
+    char *buffer = (char *) malloc(length + 1);
+    passed = passed && !exportStringsToBuffer(tree, buffer, length) &&
+             exportStringsToBuffer(tree, buffer, length + 1) && strcmp(buffer, expected) == 0;
+    free(buffer);
+
+    char *exported = exportStrings(tree);
+    passed = passed && exported != NULL && strcmp(exported, expected) == 0;
+    free(exported);
+
+    size_t growableLength = 0;
+    exported = exportStringsGrowable(tree, &growableLength);
+    passed = passed && exported != NULL && growableLength == length && strcmp(exported, expected) == 0;
+    free(exported);
+
+    StringCursor cursor = {NULL, 0, 0, 1, -1};
+    passed = passed && forEachRBTree(tree, concatenateAt, &cursor) && cursor.length == length &&
+             strcmp(cursor.buffer, expected) == 0;
+    free(cursor.buffer);
+
+    FILE *file = tmpfile();
+    buffer = (char *) calloc(length + 2, 1);
+    passed = passed && file != NULL && exportStringsToFd(tree, fileno(file)) && fseek(file, 0, SEEK_SET) == 0 &&
+             fread(buffer, 1, length + 1, file) == length && strcmp(buffer, expected) == 0;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    free(buffer);
+
+    if (!passed)
+    {
+        printf("The exported strings don't match concatenate.\n");
+    }
+    free(expected);
+    freeRBTree(tree);
+    return passed;
+}
+
+int main()
+{
+    if (!testKDTree() || !testKDTreeFromRBTree() || !testInlineVectors() ||
+        !testExportStrings())
+    {
+        printf("Test failed, aborting");
+        return 1;
+    }
+    printf("structs test passed\n");
+    return 0;
+}
+
+
+#endif //TA_EX3_STRUCTSEXAMPLE_C